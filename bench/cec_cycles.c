@@ -0,0 +1,272 @@
+/*
+ * Runs a benchmark firmware build under simavr with scripted traffic on
+ * the CEC line and reports cycle counts for each probe as CSV:
+ *
+ *	config,mcu,f_cpu,probe,count,min,mean,max
+ *
+ * The script is an initiator at address 0 that waits for the line to
+ * be free for 7 bit periods, then sends a frame with nominal timing,
+ * alternating between frames to the firmware (logical address 4) that
+ * it has to ack and broadcasts. Frames run from 1 to 16 bytes.
+ *
+ * Usage: cec_cycles -c config -m mcu -f f_cpu [-t seconds] firmware.elf
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_io.h>
+#include <avr_ioport.h>
+
+/* Data space addresses, the same on the ATtiny25/45/85 */
+#define ADDR_USIDR	0x2f
+#define ADDR_USICR	0x2d
+#define ADDR_GPIOR2	0x33
+#define ADDR_DDRB	0x37
+#define ADDR_PORTB	0x38
+
+#define PBIN		0
+#define PBOUT		1
+#define USIWM0		4
+
+static const char *probe_names[] = {
+	"cec_periodic",
+	"cec_process_tick",
+	"cec_receive_do_ack",
+	"cec_receive_bit",
+	"cec_dispatch_lookup",
+	"cec_usi_pcint",
+	"cec_usi_next_bit",
+};
+#define PROBES	(sizeof(probe_names) / sizeof(probe_names[0]))
+
+struct probe {
+	avr_cycle_count_t enter;
+	unsigned long count;
+	unsigned long long sum;
+	unsigned long min;
+	unsigned long max;
+};
+
+static struct probe probes[PROBES];
+static avr_t *avr;
+
+static void probe_write(avr_t *avr, avr_io_addr_t addr, uint8_t v,
+								void *param)
+{
+	uint8_t changed = avr->data[addr] ^ v;
+	unsigned long cycles;
+	unsigned char i;
+
+	avr->data[addr] = v;
+
+	for (i = 0; i < PROBES; i++) {
+		struct probe *p = &probes[i];
+
+		if (!(changed & (1 << i)))
+			continue;
+
+		if (v & (1 << i)) {
+			p->enter = avr->cycle;
+			continue;
+		}
+
+		cycles = avr->cycle - p->enter;
+		if (!p->count || cycles < p->min)
+			p->min = cycles;
+		if (cycles > p->max)
+			p->max = cycles;
+		p->sum += cycles;
+		p->count++;
+	}
+}
+
+/* Scripted initiator, times in uS from the start of the frame */
+static unsigned char frame[16];
+static unsigned char frame_len;
+static unsigned char frame_bit;
+static bool frame_active;
+static bool frame_bcast;
+static double frame_start;
+static double idle_since;
+
+static bool script_bit(unsigned char n)
+{
+	unsigned char byte = n / 10;
+	unsigned char bit = n % 10;
+
+	if (bit < 8)
+		return frame[byte] & (0x80 >> bit);
+	if (bit == 8)
+		/* EOM */
+		return byte == frame_len - 1;
+	/* Ack, the follower pulls it low */
+	return true;
+}
+
+static void script_next(void)
+{
+	static unsigned int n;
+	unsigned char i;
+
+	frame_bcast = n & 1;
+	frame_len = 1 + (n / 2) % 16;
+	frame[0] = frame_bcast ? 0x0f : 0x04;
+	for (i = 1; i < frame_len; i++)
+		frame[i] = n * 37 + i * 101;
+	n++;
+}
+
+/* Whether the script pulls the line low at time t */
+static bool script_low(double t, bool line_high)
+{
+	double rel;
+	unsigned char bit;
+
+	if (!frame_active) {
+		if (!line_high) {
+			idle_since = t;
+			return false;
+		}
+		if (t - idle_since < 7 * 2400)
+			return false;
+		frame_active = true;
+		frame_start = t;
+	}
+
+	rel = t - frame_start;
+	if (rel < 4500)
+		return rel < 3700;
+
+	rel -= 4500;
+	bit = rel / 2400;
+	if (bit >= frame_len * 10) {
+		frame_active = false;
+		idle_since = t;
+		script_next();
+		return false;
+	}
+	rel -= bit * 2400.0;
+	return rel < (script_bit(bit) ? 600 : 1500);
+}
+
+static bool firmware_low(void)
+{
+	uint8_t ddr = avr->data[ADDR_DDRB];
+	uint8_t out;
+
+	if (!(ddr & (1 << PBOUT)))
+		/* Input, the pull-up turns the transistor on */
+		return true;
+
+	/* In three wire mode the USI drives DO */
+	if (avr->data[ADDR_USICR] & (1 << USIWM0))
+		out = avr->data[ADDR_USIDR] & 0x80;
+	else
+		out = avr->data[ADDR_PORTB] & (1 << PBOUT);
+	return out != 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "cec_cycles -c config -m mcu -f f_cpu "
+					"[-t seconds] firmware.elf\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	elf_firmware_t fw;
+	const char *config = NULL;
+	const char *mcu = NULL;
+	unsigned long f_cpu = 0;
+	double seconds = 10;
+	avr_irq_t *pin;
+	bool line_high = true;
+	bool low;
+	double t;
+	unsigned char i;
+	int state;
+	int c;
+
+	while ((c = getopt(argc, argv, "c:m:f:t:")) != -1) {
+		switch (c) {
+		case 'c': config = optarg; break;
+		case 'm': mcu = optarg; break;
+		case 'f': f_cpu = strtoul(optarg, NULL, 0); break;
+		case 't': seconds = strtod(optarg, NULL); break;
+		default: usage();
+		}
+	}
+	if (!config || !mcu || !f_cpu || optind != argc - 1)
+		usage();
+
+	memset(&fw, 0, sizeof(fw));
+	if (elf_read_firmware(argv[optind], &fw)) {
+		fprintf(stderr, "can't read %s\n", argv[optind]);
+		return 1;
+	}
+
+	avr = avr_make_mcu_by_name(mcu);
+	if (!avr) {
+		fprintf(stderr, "unknown mcu %s\n", mcu);
+		return 1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &fw);
+	avr->frequency = f_cpu;
+
+	avr_register_io_write(avr, ADDR_GPIOR2, probe_write, NULL);
+	pin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), PBIN);
+
+	script_next();
+	do {
+		state = avr_run(avr);
+
+		/* Wired-AND of the firmware and the script */
+		t = avr->cycle * 1000000.0 / f_cpu;
+		low = firmware_low() || script_low(t, line_high);
+		if (low == line_high) {
+			line_high = !low;
+			/* The input is inverted */
+			avr_raise_irq(pin, low);
+		}
+	} while (state != cpu_Done && state != cpu_Crashed &&
+						t < seconds * 1000000);
+
+	if (state == cpu_Crashed) {
+		fprintf(stderr, "%s crashed\n", argv[optind]);
+		return 1;
+	}
+
+	for (i = 0; i < PROBES; i++) {
+		struct probe *p = &probes[i];
+
+		printf("%s,%s,%lu,%s,%lu,%lu,%.1f,%lu\n", config, mcu, f_cpu,
+			probe_names[i], p->count, p->min,
+			p->count ? (double) p->sum / p->count : 0.0, p->max);
+	}
+
+	return 0;
+}
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Compare two cycles.csv reports, printing every probe whose worst case
+# changed. Exits non-zero if any worst case grew, or if a probe that
+# ran in the old report has no samples in the new one.
+#
+#   ./compare.sh old.csv new.csv
+
+if [ $# -ne 2 ]; then
+	echo "usage: $0 old.csv new.csv" >&2
+	exit 2
+fi
+
+awk -F, '
+FNR == 1 { next }
+NR == FNR { old[$1 "," $2 "," $3 "," $4] = $8; n[$1 "," $2 "," $3 "," $4] = $5; next }
+{
+	key = $1 "," $2 "," $3 "," $4
+	if (!(key in old))
+		next
+	if (n[key] && !$5) {
+		printf "%s: no samples\n", key
+		bad = 1
+	} else if ($8 > old[key]) {
+		printf "%s: max %d -> %d\n", key, old[key], $8
+		bad = 1
+	} else if ($8 < old[key])
+		printf "%s: max %d -> %d\n", key, old[key], $8
+}
+END { exit bad }
+' "$1" "$2"
@@ -0,0 +1,156 @@
+/*
+ * Benchmark firmware for the simavr cycle counts. It runs the library
+ * the way an app would, releasing whatever comes in and broadcasting a
+ * message every so often, while the probes in cec_hal.h mark the
+ * sections being measured in CEC_BENCH_PROBES. The driver configuration
+ * comes from the Makefile.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#define CEC_DDR		DDRB
+#define CEC_PIN		PINB
+#define CEC_PORT	PORTB
+#define CEC_PBIN	PB0
+#define CEC_PBOUT	PB1
+
+#define CEC_BENCH_PROBES		GPIOR2
+#define CEC_FIXED_LOGICAL_ADDRESS	CEC_ADDR_PLAYBACK_DEVICE_1
+
+#ifdef CEC_BENCH_DISPATCH
+/* Every opcode in cec_msg.h, to measure the full table */
+static void bench_handler(const unsigned char *msg, unsigned char len)
+{
+}
+
+#define CEC_DISPATCH(X) \
+	X(CEC_MSG_FEATURE_ABORT, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_IMAGE_VIEW_ON, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_TUNER_STEP_INCREMENT, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_TUNER_STEP_DECREMENT, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_TUNER_DEVICE_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GIVE_TUNER_DEVICE_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_RECORD_ON, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_RECORD_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_RECORD_OFF, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_TEXT_VIEW_ON, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_RECORD_TV_SCREEN, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GIVE_DECK_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_DECK_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_MENU_LANGUAGE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_CLEAR_ANALOGUE_TIMER, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_ANALOGUE_TIMER, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_TIMER_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_STANDBY, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_PLAY, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_DECK_CONTROL, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_TIMER_CLEARED_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_USER_CONTROL_PRESSED, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_USER_CONTROL_RELEASED, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GIVE_OSD_NAME, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_OSD_NAME, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_OSD_STRING, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_TIMER_PROGRAM_TITLE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SYSTEM_AUDIO_MODE_REQUEST, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GIVE_AUDIO, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_SYSTEM_AUDIO_MODE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_REPORT_AUDIO_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GIVE_SYSTEM_AUDIO_MODE_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SYSTEM_AUDIO_MODE_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_ROUTING_CHANGE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_ROUTING_INFORMATION, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_ACTIVE_SOURCE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GIVE_PHYSICAL_ADDRESS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_REPORT_PHYSICAL_ADDRESS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_REQUEST_ACTIVE_SOURCE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_STREAM_PATH, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_DEVICE_VENDOR_ID, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_VENDOR_COMMAND, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_VENDOR_REMOTE_BUTTON_DOWN, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_VENDOR_REMOTE_BUTTON_UP, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GIVE_DEVICE_VENDOR_ID, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_MENU_REQUEST, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_MENU_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GIVE_DEVICE_POWER_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_REPORT_POWER_STATUS, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GET_MENU_LANGUAGE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SELECT_ANALOGUE_SERVICE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SELECT_DIGITAL_SERVICE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_DIGITAL_TIMER, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_CLEAR_DIGITAL_TIMER, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_AUDIO_RATE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_INACTIVE_SOURCE, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_CEC_VERSION, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_GET_CEC_VERSION, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_VENDOR_COMMAND_WITH_ID, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_CLEAR_EXTERNAL_TIMER, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_SET_EXTERNAL_TIMER, 0, 14, CEC_DISPATCH_BOTH, bench_handler) \
+	X(CEC_MSG_ABORT, 0, 14, CEC_DISPATCH_BOTH, bench_handler)
+
+#endif
+
+#include "../cec.c"
+#include "../cec_msg.h"
+
+#ifdef CEC_USI
+static void cec_usi_frame_hook(void)
+{
+}
+#endif
+
+int main(void)
+{
+	unsigned char last;
+	unsigned char now;
+#if !CEC_MONITOR
+	unsigned int loops = 0;
+#endif
+
+#ifndef CEC_USI
+	/* Free running, cec_periodic gets the jiffies since the last call */
+	TCCR0B = TCNT0_PRESCALER_VAL;
+#endif
+	cec_init();
+	sei();
+
+	last = TCNT0;
+	for (;;) {
+		now = TCNT0;
+		cec_periodic((unsigned char) (now - last));
+		last = now;
+
+#ifdef CEC_BENCH_DISPATCH
+		cec_dispatch();
+#else
+		if (cec_receive_buf[0])
+			cec_receive_release();
+#endif
+
+#if !CEC_MONITOR
+		if (!++loops && transmit_state < TRANSMIT_PEND) {
+			transmit_buf[0] = cec_addr_build(0, CEC_ADDR_BROADCAST);
+			transmit_buf[1] = CEC_MSG_REPORT_POWER_STATUS;
+			transmit_buf[2] = CEC_MSG_POWER_STATUS_ON;
+			transmit_buf_end = 2;
+			transmit_state = TRANSMIT_PEND;
+		}
+#endif
+	}
+}
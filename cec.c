@@ -16,13 +16,19 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
  * 02110-1301  USA
  */
+#include "cec_instance.h"
 #include "cec.h"
+#include "cec_event.c"
+#include "cec_timer.c"
 
 #if CEC_MONITOR
 static void cec_transmit_receive_ack(bool bit) {}
-static void cec_transmit_on_error(void) {}
+static void cec_transmit_on_error(unsigned char err) {}
+static void cec_transmit_finish_abort(void) {}
 static void cec_check_tx_bit(bool bit) {}
+#ifndef CEC_USI
 static void cec_transmit_periodic(unsigned int delta) {}
+#endif
 static void cec_transmit_halt(void) {}
 static inline void cec_transmit_init(void) {}
 #else
@@ -33,8 +39,14 @@ static inline void cec_transmit_init(void) {}
 
 #ifdef CEC_USI
 #include "cec_usi.c"
+#elif defined(CEC_ICP)
+#include "cec_icp.c"
+#else
+#ifdef CEC_RECEIVE_PCINT
+#include "cec_receive_pcint.c"
 #else
 #include "cec_receive_min.c"
+#endif
 #if CEC_MONITOR
 /* No transmit capability */
 #elif defined(CEC_TRANSMIT_PWM)
@@ -44,7 +56,9 @@ static inline void cec_transmit_init(void) {}
 #endif
 #endif
 
-#ifdef CEC_DEV_TYPE
+#ifdef CEC_DEV_TYPES
+#include "cec_addr_dev_types.c"
+#elif defined(CEC_DEV_TYPE)
 #include "cec_addr_dev_type.c"
 #elif defined(CEC_LOGICAL_ADDRESS_BITFIELD)
 #include "cec_addr_bitfield.c"
@@ -54,9 +68,15 @@ static inline void cec_transmit_init(void) {}
 #include "cec_addr_none.c"
 #endif
 
+#include "cec_respond.c"
+#include "cec_topo.c"
+#include "cec_dispatch.c"
+
 CEC_PUBLIC void cec_init(void)
 {
 	cec_pin_config();
+	cec_respond_init();
+	cec_topo_init();
 	cec_receive_init();
 	cec_transmit_init();
 	cec_addr_init();
@@ -64,15 +84,26 @@ CEC_PUBLIC void cec_init(void)
 
 CEC_PUBLIC void cec_periodic(unsigned int delta)
 {
+	cec_probe_enter(CEC_PROBE_PERIODIC);
+#ifdef CEC_DRIVER_DELTA
+	/* The driver keeps its own time */
+	delta = cec_driver_delta();
+#endif
+	cec_timer_periodic(delta);
 	cec_receive_periodic(delta);
 	cec_transmit_periodic(delta);
 	cec_addr_periodic();
+	cec_respond_periodic();
+	cec_topo_periodic(delta);
+	cec_probe_exit(CEC_PROBE_PERIODIC);
 }
 
 CEC_PUBLIC void cec_halt(void)
 {
 	cec_receive_error(CEC_ERR_HALT);
 	cec_receive_halt();
+	cec_respond_init();
+	cec_topo_init();
 	cec_transmit_halt();
 	cec_addr_init();
 }
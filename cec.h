@@ -21,6 +21,9 @@
 
 #include <avr/io.h>
 
+#include "cec_config.h"
+#include "cec_hal.h"
+
 #include <stdbool.h>
 
 #define ARRAY_SIZE(n)	(sizeof(n) / sizeof((n)[0]))
@@ -31,10 +34,6 @@
 #define CEC_PUBLIC
 #endif
 
-#ifndef CEC_MONITOR
-#define CEC_MONITOR 0
-#endif
-
 /* Error types */
 #define CEC_ERR_NONE		0
 #define CEC_ERR_ARB_LOST	1
@@ -44,21 +43,22 @@
 #define CEC_ERR_HALT		5
 #define CEC_ERR_HW		6
 
-#define CEC_STATUS_OVERRUN	_BV(6)
-#define CEC_STATUS_NACK		_BV(7)
+/* Event types, see cec_event.c */
+#define CEC_EVENT_NONE		0
+#define CEC_EVENT_RX		1	/* arg is the receive header byte */
+#define CEC_EVENT_TX_DONE	2	/* arg is the queue priority */
+#define CEC_EVENT_TX_FAILED	3	/* arg is priority << 4 | CEC_ERR_* */
+#define CEC_EVENT_ADDR		4	/* arg is the new logical address */
+#define CEC_EVENT_BUS_ERROR	5	/* arg is the CEC_ERR_* */
+#define CEC_EVENT_TIMER		6	/* arg is the timer id */
 
-CEC_PUBLIC void cec_init(void);
-CEC_PUBLIC void cec_halt(void) __attribute__((unused));
-CEC_PUBLIC void cec_periodic(unsigned int delta);
+/* Addressing an opcode is accepted with, see cec_dispatch.c */
+#define CEC_DISPATCH_DIRECT	_BV(0)
+#define CEC_DISPATCH_BCAST	_BV(1)
+#define CEC_DISPATCH_BOTH	(CEC_DISPATCH_DIRECT | CEC_DISPATCH_BCAST)
 
-CEC_PUBLIC void cec_transmit_init_hw(void);
-
-CEC_PUBLIC bool cec_addr_match(unsigned char addr) __attribute__((unused));
-CEC_PUBLIC void cec_addr_init(void);
-CEC_PUBLIC void cec_addr_periodic(void);
-CEC_PUBLIC bool cec_addr_ready(void) __attribute__((unused));
-CEC_PUBLIC unsigned char cec_addr_build(unsigned char source,
-			unsigned char target) __attribute__((unused));
+#define CEC_STATUS_OVERRUN	_BV(6)
+#define CEC_STATUS_NACK		_BV(7)
 
 /*
  * There is a pull-up resistor on the output line. If we set the output
@@ -96,8 +96,6 @@ CEC_PUBLIC unsigned char cec_addr_build(unsigned char source,
 
 #define cec_output_state()		(!(CEC_PIN & _BV(CEC_PBOUT)))
 
-#define cec_input_state()		(!(CEC_PIN & _BV(CEC_PBIN)))
-
 #define cec_pin_config() do {		\
 	CEC_DDR |= _BV(CEC_PBOUT);	\
 	CEC_PORT |= _BV(CEC_PBIN);	\
@@ -110,4 +108,46 @@ CEC_PUBLIC unsigned char cec_addr_build(unsigned char source,
 } while (0)
 #endif
 
+#define cec_input_state()		(!(CEC_PIN & _BV(CEC_PBIN)))
+
+#endif
+
+/* Outside the guard, each instance needs its own (see cec_instance.h) */
+CEC_PUBLIC void cec_init(void);
+CEC_PUBLIC void cec_halt(void) __attribute__((unused));
+CEC_PUBLIC void cec_periodic(unsigned int delta);
+
+CEC_PUBLIC void cec_transmit_init_hw(void);
+
+CEC_PUBLIC void cec_receive_release(void);
+
+#ifdef CEC_EVENTS
+CEC_PUBLIC unsigned char cec_event_get(unsigned char *arg);
+#endif
+
+#ifdef CEC_TIMERS
+CEC_PUBLIC void cec_timer_start(unsigned char id, unsigned short ticks);
+CEC_PUBLIC void cec_timer_stop(unsigned char id);
 #endif
+
+#ifdef CEC_DISPATCH
+CEC_PUBLIC bool cec_dispatch(void);
+CEC_PUBLIC void cec_feature_abort(const unsigned char *msg,
+			unsigned char reason) __attribute__((unused));
+#endif
+
+#ifdef CEC_TOPOLOGY
+struct cec_topo_dev;
+CEC_PUBLIC bool cec_topo_get(unsigned char addr,
+			struct cec_topo_dev *dev) __attribute__((unused));
+CEC_PUBLIC unsigned short cec_topo_devices(void) __attribute__((unused));
+CEC_PUBLIC unsigned short cec_topo_age(unsigned char addr) __attribute__((unused));
+CEC_PUBLIC void cec_topo_forget(unsigned char addr) __attribute__((unused));
+#endif
+
+CEC_PUBLIC bool cec_addr_match(unsigned char addr) __attribute__((unused));
+CEC_PUBLIC void cec_addr_init(void);
+CEC_PUBLIC void cec_addr_periodic(void);
+CEC_PUBLIC bool cec_addr_ready(void) __attribute__((unused));
+CEC_PUBLIC unsigned char cec_addr_build(unsigned char source,
+			unsigned char target) __attribute__((unused));
@@ -34,6 +34,11 @@ static unsigned char logical_address;
 
 static unsigned char cec_dev_idx;
 
+#ifdef CEC_TRANSMIT_QUEUE
+/* Queue entry holding our current polling message */
+static struct cec_transmit_entry *cec_addr_poll;
+#endif
+
 /* Static table of which addresses are available given a device type */
 PROGMEM static const unsigned char cec_dev_addrs[] = {
 #ifndef CEC_DEV_TYPE
@@ -57,12 +62,182 @@ PROGMEM static const unsigned char cec_dev_addrs[] = {
 #endif
 };
 
-/* source is always our assigned logical address */
+#ifdef CEC_ADDR_CACHE
+#include <avr/eeprom.h>
+
+/*
+ * CEC_ADDR_CACHE is the EEPROM offset of a ring of two byte records. The
+ * first byte holds a 4 bit sequence number and the address we last
+ * claimed, the second the cec_dev_addrs entries that answered a poll.
+ * The newest record is the one before the first break in the sequence,
+ * each update goes to the next one to spread the wear.
+ */
+#ifndef CEC_ADDR_CACHE_SLOTS
+#define CEC_ADDR_CACHE_SLOTS	8
+#endif
+
+#if CEC_ADDR_CACHE_SLOTS < 2 || CEC_ADDR_CACHE_SLOTS > 15
+#error "CEC_ADDR_CACHE_SLOTS must be 2 to 15"
+#endif
+
+#define cec_addr_cache_rec(n)	((unsigned char *) (CEC_ADDR_CACHE) + 2 * (n))
+
+/* Newest record, written out by cec_addr_periodic */
+static unsigned char cec_addr_cache_slot;
+static unsigned char cec_addr_cache_seq;
+static unsigned char cec_addr_cache_busy;
+static unsigned char cec_addr_cache_write;	/* Bytes left to write */
+
+/* cec_dev_addrs entries polled and answered this time */
+static unsigned char cec_addr_polled;
+static unsigned char cec_addr_busy;
+
+/* Order to poll in, indices into cec_dev_addrs */
+static unsigned char cec_dev_order[sizeof(cec_dev_addrs)];
+
+#define cec_dev_addr(idx)	pgm_read_byte(cec_dev_addrs + cec_dev_order[idx])
+
+static void cec_addr_cache_load(void)
+{
+	unsigned char i;
+	unsigned char n;
+	unsigned char seq;
+	unsigned char next;
+
+	if (!cec_addr_cache_write) {
+		/* Nothing waiting to go out, find the newest record */
+		seq = eeprom_read_byte(cec_addr_cache_rec(0));
+		for (i = 0; i < CEC_ADDR_CACHE_SLOTS - 1; i++) {
+			next = eeprom_read_byte(cec_addr_cache_rec(i + 1));
+			if (((next ^ (seq + 0x10)) & 0xf0))
+				break;
+			seq = next;
+		}
+		cec_addr_cache_slot = i;
+		cec_addr_cache_seq = seq;
+		cec_addr_cache_busy = seq == 0xff ? 0 :
+			eeprom_read_byte(cec_addr_cache_rec(i) + 1);
+	}
+
+	/* Last address first, then the ones that were free, then the rest */
+	n = 0;
+	for (i = 0; i < sizeof(cec_dev_addrs); i++)
+		if ((pgm_read_byte(cec_dev_addrs + i) & 0xf) ==
+						(cec_addr_cache_seq & 0xf))
+			cec_dev_order[n++] = i;
+	for (i = 0; i < sizeof(cec_dev_addrs); i++)
+		if ((pgm_read_byte(cec_dev_addrs + i) & 0xf) !=
+						(cec_addr_cache_seq & 0xf) &&
+		    !(cec_addr_cache_busy & _BV(i)))
+			cec_dev_order[n++] = i;
+	for (i = 0; i < sizeof(cec_dev_addrs); i++)
+		if ((pgm_read_byte(cec_dev_addrs + i) & 0xf) !=
+						(cec_addr_cache_seq & 0xf) &&
+		    (cec_addr_cache_busy & _BV(i)))
+			cec_dev_order[n++] = i;
+
+	cec_addr_polled = 0;
+	cec_addr_busy = 0;
+}
+
+/* A poll was sent to the entry at idx, did anyone answer it */
+static void cec_addr_cache_poll(unsigned char idx, bool answered)
+{
+	idx = cec_dev_order[idx];
+	cec_addr_polled |= _BV(idx);
+	if (answered)
+		cec_addr_busy |= _BV(idx);
+}
+
+static void cec_addr_cache_store(unsigned char addr)
+{
+	unsigned char busy;
+
+	/* Entries we didn't get to keep what we knew about them */
+	busy = (cec_addr_cache_busy & ~cec_addr_polled) | cec_addr_busy;
+	if ((cec_addr_cache_seq & 0xf) == addr && cec_addr_cache_busy == busy)
+		return;
+
+	if (++cec_addr_cache_slot == CEC_ADDR_CACHE_SLOTS)
+		cec_addr_cache_slot = 0;
+	cec_addr_cache_seq = ((cec_addr_cache_seq + 0x10) & 0xf0) | addr;
+	cec_addr_cache_busy = busy;
+	cec_addr_cache_write = 2;
+}
+
+/* One byte at a time, and only once the last one is done */
+static void cec_addr_cache_periodic(void)
+{
+	if (cec_addr_cache_write && eeprom_is_ready()) {
+		/* Sequence byte last, it makes the record valid */
+		cec_addr_cache_write--;
+		eeprom_write_byte(cec_addr_cache_rec(cec_addr_cache_slot) +
+			cec_addr_cache_write, cec_addr_cache_write ?
+			cec_addr_cache_busy : cec_addr_cache_seq);
+	}
+}
+#else
+#define cec_dev_addr(idx)	pgm_read_byte(cec_dev_addrs + (idx))
+#define cec_addr_cache_load()		do {} while (0)
+#define cec_addr_cache_poll(idx, answered) do {} while (0)
+#define cec_addr_cache_store(addr)	do {} while (0)
+#define cec_addr_cache_periodic()	do {} while (0)
+#endif
+
+#ifdef CEC_ADDR_CONFLICT
+/*
+ * Someone else sending from our address means they claimed it too. Poll
+ * for another one in the background and keep using ours until then. From
+ * unregistered, poll again every CEC_ADDR_RECHECK_S seconds in case an
+ * address was freed.
+ */
+#ifndef CEC_TRANSMIT_QUEUE
+#error "CEC_ADDR_CONFLICT needs CEC_TRANSMIT_QUEUE"
+#endif
+
+#ifndef CEC_ADDR_RECHECK_S
+#define CEC_ADDR_RECHECK_S	10
+#endif
+
+#if S_TO_JIFFIES(CEC_ADDR_RECHECK_S) > 0xffffff
+#error "CEC_ADDR_RECHECK_S does not fit in jiffies"
+#endif
+
+static bool cec_addr_polling;
+static volatile bool cec_addr_conflicted;	/* Set by the receive engine */
+static __uint24 cec_addr_settled;		/* When we last picked one */
+
+static void cec_addr_conflict(void)
+{
+	cec_addr_conflicted = true;
+}
+
+static void cec_addr_recheck(void)
+{
+	if (cec_addr_polling)
+		return;
+
+	if (cec_addr_conflicted || (logical_address == CEC_ADDR_UNREGISTERED &&
+	    (__uint24) (jiffies() - cec_addr_settled) >=
+					S_TO_JIFFIES(CEC_ADDR_RECHECK_S))) {
+		cec_addr_polling = true;
+		cec_dev_idx = 0;
+		cec_addr_cache_load();
+		cec_addr_poll = NULL;
+	}
+}
+#else
+#define cec_addr_polling		(!cec_addr_ready())
+#define cec_addr_recheck()		do {} while (0)
+#endif
+
+/*
+ * source is always our assigned logical address, unregistered until we
+ * have one
+ */
 CEC_PUBLIC unsigned char cec_addr_build(unsigned char source, unsigned char target)
 {
-	unsigned char ret = logical_address;
-	asm("swap %[ret]" : [ret] "+r"(ret));
-	return ret | target;
+	return cec_swap(logical_address & 0xf) | target;
 }
 
 /* 0xff indicates we aren't ready */
@@ -76,39 +251,124 @@ CEC_PUBLIC bool cec_addr_match(unsigned char addr)
 	return addr == logical_address;
 }
 
+static void cec_addr_set(unsigned char addr)
+{
+#ifdef CEC_TRANSMIT_QUEUE
+	unsigned char old = logical_address;
+#endif
+
+	cec_addr_cache_store(addr);
+#ifdef CEC_ADDR_CONFLICT
+	cec_addr_polling = false;
+	cec_addr_conflicted = false;
+	cec_addr_settled = jiffies();
+	if (addr == old)
+		/* Still nothing better than unregistered */
+		return;
+#endif
+	logical_address = addr;
+#ifdef CEC_TRANSMIT_QUEUE
+	cec_transmit_release_held(old & 0xf, addr);
+#endif
+	cec_event_post(CEC_EVENT_ADDR, addr);
+}
+
 CEC_PUBLIC void cec_addr_init(void)
 {
 	logical_address = 0xff;
 	cec_dev_idx = 0;
+	cec_addr_cache_load();
+#ifdef CEC_TRANSMIT_QUEUE
+	/* Our poll entry is the queue's, cec_transmit_halt() cleans up */
+	cec_addr_poll = NULL;
+#else
 	transmit_state = TRANSMIT_IDLE;
+#endif
+#ifdef CEC_ADDR_CONFLICT
+	cec_addr_polling = true;
+	cec_addr_conflicted = false;
+#endif
 }
 
 /*
  * This will do work until we have a valid address or fallback to
- * the unregistered address.
+ * the unregistered address, and again on a conflict.
  */
 CEC_PUBLIC void cec_addr_periodic(void)
 {
-	if (cec_addr_ready())
+	cec_addr_cache_periodic();
+	cec_addr_recheck();
+
+	if (!cec_addr_polling)
 		return;
 
-	/* Throw away any messages */
-	cec_receive_buf[CEC_RECEIVE_BUF_HDR] = 0;
+#ifdef CEC_TRANSMIT_QUEUE
+	struct cec_transmit_entry *e = cec_addr_poll;
+
+	if (e) {
+		if (e->state == TRANSMIT_PEND)
+			/* Still polling */
+			return;
+
+		if (e->state == TRANSMIT_FAILED) {
+			/* Found a non-acked address */
+			cec_addr_cache_poll(cec_dev_idx - 1, false);
+			cec_addr_set(e->buf[0] & 0xf);
+			return;
+		}
+
+		/* Someone has it */
+		cec_addr_cache_poll(cec_dev_idx - 1, true);
+		cec_addr_poll = NULL;
+	}
+
+#ifdef CEC_ADDR_CONFLICT
+	/* The one we have is taken */
+	if (cec_dev_idx < sizeof(cec_dev_addrs) &&
+	    (cec_dev_addr(cec_dev_idx) & 0xf) == logical_address) {
+		cec_addr_cache_poll(cec_dev_idx, true);
+		cec_dev_idx++;
+	}
+#endif
+
+	if (cec_dev_idx == sizeof(cec_dev_addrs)) {
+		/* We failed, every address returned a reply */
+		cec_addr_set(CEC_ADDR_UNREGISTERED);
+		return;
+	}
 
+	/* Keep trying until we find a non-acked address */
+	e = cec_transmit_alloc(TRANSMIT_PRIO_REPLY);
+	if (!e)
+		return;
+	e->buf[0] = cec_dev_addr(cec_dev_idx);
+	e->end = 0;
+	e->flags = TRANSMIT_ENTRY_POLL;
+	cec_dev_idx++;
+	cec_transmit_commit(TRANSMIT_PRIO_REPLY);
+	cec_addr_poll = e;
+#else
 	if (transmit_state == TRANSMIT_IDLE) {
+		if (cec_dev_idx)
+			/* Someone has it */
+			cec_addr_cache_poll(cec_dev_idx - 1, true);
+
 		if (cec_dev_idx == sizeof(cec_dev_addrs))
 			/* We failed, every address returned a reply */
-			logical_address = CEC_ADDR_UNREGISTERED;
+			cec_addr_set(CEC_ADDR_UNREGISTERED);
 
 		else {
 			/* Keep trying until we find a non-acked address */
-			transmit_buf[0] = pgm_read_byte(cec_dev_addrs + cec_dev_idx);
+			transmit_buf[0] = cec_dev_addr(cec_dev_idx);
 			cec_dev_idx++;
 			transmit_buf_end = 0;
 			transmit_state = TRANSMIT_PEND;
 		}
 
-	} else if (transmit_state == TRANSMIT_FAILED)
+	} else if (transmit_state == TRANSMIT_FAILED) {
 		/* Found a non-acked address */
-		logical_address = transmit_buf[0] & 0xf;
+		cec_addr_cache_poll(cec_dev_idx - 1, false);
+		cec_addr_set(transmit_buf[0] & 0xf);
+	}
+#endif
 }
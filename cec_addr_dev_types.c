@@ -0,0 +1,240 @@
+/*
+ * Address assignment for a box that is several devices at once. One
+ * logical address is claimed for each device type in CEC_DEV_TYPES, the
+ * polls for the different types take turns on the bus.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "cec.h"
+#include "cec_spec.h"
+
+#if defined(CEC_ADDR_CACHE) || defined(CEC_ADDR_CONFLICT)
+#error "CEC_ADDR_CACHE and CEC_ADDR_CONFLICT need a single CEC_DEV_TYPE"
+#endif
+
+/* Bit n is set once we hold logical address n */
+CEC_PUBLIC unsigned short logical_addresses;
+
+#define CEC_DEV_TYPE_ID(type)		type,
+#define CEC_DEV_TYPE_ADDRS(type)	{ type ## _ADDRS, 0xff },
+
+/* The types in CEC_DEV_TYPES order, the first one is the main one */
+PROGMEM static const unsigned char cec_dev_types[] = {
+	CEC_DEV_TYPES(CEC_DEV_TYPE_ID)
+};
+
+#define CEC_DEV_NTYPES		sizeof(cec_dev_types)
+
+/* Addresses each type may poll for, 0xff ends the list */
+PROGMEM static const unsigned char cec_dev_addrs[][5] = {
+	CEC_DEV_TYPES(CEC_DEV_TYPE_ADDRS)
+};
+
+/* Address claimed by each type, 0xff until it has one */
+static unsigned char cec_dev_logical[CEC_DEV_NTYPES];
+static unsigned char cec_dev_idx[CEC_DEV_NTYPES];
+
+/* Types still polling */
+static unsigned char cec_addr_pending;
+
+#ifdef CEC_TRANSMIT_QUEUE
+/* Queue entry holding the current polling message of each type */
+static struct cec_transmit_entry *cec_addr_poll[CEC_DEV_NTYPES];
+#else
+/* Type whose poll is in transmit_buf, 0xff if none */
+static unsigned char cec_addr_cur;
+static unsigned char cec_addr_turn;
+#endif
+
+/* Type index of a CEC_DEV_* value, the main type if we aren't one */
+static unsigned char cec_addr_type_idx(unsigned char type)
+{
+	unsigned char i = CEC_DEV_NTYPES;
+
+	while (--i && pgm_read_byte(cec_dev_types + i) != type)
+		;
+	return i;
+}
+
+/* CEC_DEV_* value of the type that claimed addr */
+static unsigned char __attribute__((unused)) cec_addr_dev_type(unsigned char addr)
+{
+	unsigned char i = CEC_DEV_NTYPES;
+
+	while (--i && cec_dev_logical[i] != addr)
+		;
+	return pgm_read_byte(cec_dev_types + i);
+}
+
+/*
+ * source is the CEC_DEV_* type sending, the header gets that type's
+ * logical address, unregistered until it has one
+ */
+CEC_PUBLIC unsigned char cec_addr_build(unsigned char source, unsigned char target)
+{
+	return cec_swap(cec_dev_logical[cec_addr_type_idx(source)] & 0xf) |
+								target;
+}
+
+/* Every type has an address, or gave up and went unregistered */
+CEC_PUBLIC bool cec_addr_ready(void)
+{
+	return !cec_addr_pending;
+}
+
+CEC_PUBLIC bool cec_addr_match(unsigned char addr)
+{
+	return (logical_addresses & (1 << addr)) != 0;
+}
+
+static void cec_addr_set(unsigned char i, unsigned char addr)
+{
+	cec_dev_logical[i] = addr;
+	logical_addresses |= 1 << addr;
+	cec_addr_pending--;
+#ifdef CEC_TRANSMIT_QUEUE
+	if (!cec_addr_pending)
+		/* Anything queued early goes out from the main type */
+		cec_transmit_release_held(CEC_ADDR_UNREGISTERED,
+						cec_dev_logical[0] & 0xf);
+#endif
+	cec_event_post(CEC_EVENT_ADDR, addr);
+}
+
+/* Next poll for type i, skipping addresses another type has, 0xff if none */
+static unsigned char cec_addr_next(unsigned char i)
+{
+	unsigned char hdr;
+
+	while ((hdr = pgm_read_byte(&cec_dev_addrs[i][cec_dev_idx[i]])) != 0xff &&
+	    cec_addr_match(hdr & 0xf))
+		cec_dev_idx[i]++;
+	return hdr;
+}
+
+/* A poll for type i finished, a non-acked address we don't hold is ours */
+static void cec_addr_poll_done(unsigned char i, unsigned char hdr, bool acked)
+{
+	if (!acked && !cec_addr_match(hdr & 0xf))
+		cec_addr_set(i, hdr & 0xf);
+	else
+		cec_dev_idx[i]++;
+}
+
+CEC_PUBLIC void cec_addr_init(void)
+{
+	unsigned char i;
+
+	logical_addresses = 0;
+	for (i = 0; i < CEC_DEV_NTYPES; i++) {
+		cec_dev_logical[i] = 0xff;
+		cec_dev_idx[i] = 0;
+#ifdef CEC_TRANSMIT_QUEUE
+		cec_addr_poll[i] = NULL;
+#endif
+	}
+	cec_addr_pending = CEC_DEV_NTYPES;
+#ifndef CEC_TRANSMIT_QUEUE
+	cec_addr_cur = 0xff;
+	cec_addr_turn = CEC_DEV_NTYPES - 1;
+	transmit_state = TRANSMIT_IDLE;
+#endif
+}
+
+/*
+ * This will do work until every type has a valid address or has fallen
+ * back to the unregistered address.
+ */
+CEC_PUBLIC void cec_addr_periodic(void)
+{
+	unsigned char i;
+	unsigned char hdr;
+
+	if (!cec_addr_pending)
+		return;
+
+#ifdef CEC_TRANSMIT_QUEUE
+	struct cec_transmit_entry *e;
+
+	/* Collect every result before a new poll can reuse its entry */
+	for (i = 0; i < CEC_DEV_NTYPES; i++) {
+		e = cec_addr_poll[i];
+		if (e && e->state != TRANSMIT_PEND) {
+			cec_addr_poll[i] = NULL;
+			cec_addr_poll_done(i, e->buf[0],
+					e->state != TRANSMIT_FAILED);
+		}
+	}
+
+	/* Each type waiting on the bus keeps one poll queued */
+	for (i = 0; i < CEC_DEV_NTYPES; i++) {
+		if (cec_dev_logical[i] != 0xff || cec_addr_poll[i])
+			continue;
+
+		hdr = cec_addr_next(i);
+		if (hdr == 0xff) {
+			/* We failed, every address returned a reply */
+			cec_addr_set(i, CEC_ADDR_UNREGISTERED);
+			continue;
+		}
+
+		e = cec_transmit_alloc(TRANSMIT_PRIO_REPLY);
+		if (!e)
+			return;
+		e->buf[0] = hdr;
+		e->end = 0;
+		e->flags = TRANSMIT_ENTRY_POLL;
+		cec_transmit_commit(TRANSMIT_PRIO_REPLY);
+		cec_addr_poll[i] = e;
+	}
+#else
+	if (transmit_state >= TRANSMIT_PEND)
+		return;
+
+	if (cec_addr_cur != 0xff) {
+		cec_addr_poll_done(cec_addr_cur, transmit_buf[0],
+					transmit_state != TRANSMIT_FAILED);
+		cec_addr_cur = 0xff;
+	}
+
+	/* Only one poll fits in transmit_buf, the types take turns */
+	for (i = 0; i < CEC_DEV_NTYPES && cec_addr_pending; i++) {
+		if (++cec_addr_turn == CEC_DEV_NTYPES)
+			cec_addr_turn = 0;
+		if (cec_dev_logical[cec_addr_turn] != 0xff)
+			continue;
+
+		hdr = cec_addr_next(cec_addr_turn);
+		if (hdr == 0xff) {
+			/* We failed, every address returned a reply */
+			cec_addr_set(cec_addr_turn, CEC_ADDR_UNREGISTERED);
+			continue;
+		}
+
+		transmit_buf[0] = hdr;
+		transmit_buf_end = 0;
+		cec_addr_cur = cec_addr_turn;
+		transmit_state = TRANSMIT_PEND;
+		return;
+	}
+#endif
+}
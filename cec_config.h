@@ -0,0 +1,40 @@
+/*
+ * Options that turn on or default other options. Everything that looks
+ * at these, cec.h and the cec_instance.h rename list included, gets them
+ * from here so they can't disagree.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#ifndef _CEC_CONFIG_H_
+#define _CEC_CONFIG_H_
+
+#ifndef CEC_MONITOR
+#define CEC_MONITOR 0
+#endif
+
+/* Re-polling from the unregistered address is timed with jiffies() */
+#if defined(CEC_ADDR_CONFLICT) && !defined(CEC_JIFFIES)
+#define CEC_JIFFIES
+#endif
+
+/* Drivers that count signal free time in bit periods rather than jiffies */
+#if defined(CEC_USI) || defined(CEC_ICP)
+#define CEC_IDLE_FRAMES
+#endif
+
+#endif
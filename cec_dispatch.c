@@ -0,0 +1,188 @@
+/*
+ * Opcode dispatch. The user app lists the opcodes it handles in
+ * CEC_DISPATCH, an X-macro of
+ *
+ *	X(opcode, min operands, max operands, addressing, handler)
+ *
+ * and gets a 256 byte opcode index plus a table of entries, both in
+ * program memory. cec_dispatch() checks the oldest received message
+ * against the table and calls its handler, or sends <Feature Abort>.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+
+#include <stdbool.h>
+
+#include <avr/pgmspace.h>
+
+#include "cec_msg.h"
+#include "cec_spec.h"
+
+#ifdef CEC_DISPATCH
+
+#ifndef _CEC_DISPATCH_ENTRY_
+#define _CEC_DISPATCH_ENTRY_
+struct cec_dispatch_entry {
+	unsigned char lens;	/* Max operands << 4 | min operands */
+	unsigned char mode;
+	void (*handler)(const unsigned char *msg, unsigned char len);
+};
+#endif
+
+/* Each instance needs its own names */
+#ifdef CEC_INSTANCE
+#define CEC_DISPATCH_IDX(op)	CEC_NAME(CEC_DISPATCH_ ## op)
+#else
+#define CEC_DISPATCH_IDX(op)	CEC_DISPATCH_ ## op
+#endif
+
+#define CEC_DISPATCH_ENUM(op, min, max, mode, handler) \
+	CEC_DISPATCH_IDX(op),
+#define CEC_DISPATCH_INDEX(op, min, max, mode, handler) \
+	[op] = CEC_DISPATCH_IDX(op),
+#define CEC_DISPATCH_ENTRY(op, min, max, mode, handler) \
+	{ ((max) << 4) | (min), mode, handler },
+
+enum {
+	CEC_DISPATCH_IDX(NONE),
+	CEC_DISPATCH(CEC_DISPATCH_ENUM)
+};
+
+PROGMEM static const unsigned char cec_dispatch_index[256] = {
+	CEC_DISPATCH(CEC_DISPATCH_INDEX)
+};
+
+/* Unlisted opcodes index the first entry, which has no handler */
+PROGMEM static const struct cec_dispatch_entry cec_dispatch_table[] = {
+	{ 0, 0, NULL },
+	CEC_DISPATCH(CEC_DISPATCH_ENTRY)
+};
+
+/* Refuse a directed message, msg points at its header byte */
+CEC_PUBLIC void cec_feature_abort(const unsigned char *msg,
+							unsigned char reason)
+{
+#if !CEC_MONITOR
+	unsigned char *buf;
+
+	/* Never answer a <Feature Abort> with another */
+	if (msg[1] == CEC_MSG_FEATURE_ABORT)
+		return;
+
+	/* Unregistered can't be replied to, it would go out as a broadcast */
+	if ((msg[0] >> 4) == CEC_ADDR_UNREGISTERED)
+		return;
+
+#ifdef CEC_TRANSMIT_QUEUE
+	struct cec_transmit_entry *e;
+
+	e = cec_transmit_alloc(TRANSMIT_PRIO_REPLY);
+	if (!e)
+		return;
+	buf = e->buf;
+	e->end = 3;
+#else
+	if (transmit_state >= TRANSMIT_PEND)
+		return;
+	buf = transmit_buf;
+	transmit_buf_end = 3;
+#endif
+	buf[0] = cec_swap(msg[0]);
+	buf[1] = CEC_MSG_FEATURE_ABORT;
+	buf[2] = msg[1];
+	buf[3] = reason;
+#ifdef CEC_TRANSMIT_QUEUE
+	cec_transmit_commit(TRANSMIT_PRIO_REPLY);
+#else
+	transmit_state = TRANSMIT_PEND;
+#endif
+#endif
+}
+
+static void cec_dispatch_msg(const unsigned char *msg, unsigned char len)
+{
+	const struct cec_dispatch_entry *e;
+	void (*handler)(const unsigned char *msg, unsigned char len);
+	unsigned char src = msg[0] >> 4;
+	unsigned char dst = msg[0] & 0xf;
+	unsigned char mode;
+	unsigned char lens;
+
+	if (dst == CEC_ADDR_BROADCAST) {
+		/* Anyone unregistered shares 15, even if we are too */
+		if (src != CEC_ADDR_UNREGISTERED && cec_addr_match(src))
+			/* One of ours */
+			return;
+		mode = CEC_DISPATCH_BCAST;
+	} else if (cec_addr_match(dst))
+		mode = CEC_DISPATCH_DIRECT;
+	else
+		/* Someone else's */
+		return;
+
+	cec_probe_enter(CEC_PROBE_DISPATCH);
+	e = cec_dispatch_table + pgm_read_byte(cec_dispatch_index + msg[1]);
+	lens = pgm_read_byte(&e->lens);
+	mode &= pgm_read_byte(&e->mode);
+	handler = pgm_read_ptr(&e->handler);
+	cec_probe_exit(CEC_PROBE_DISPATCH);
+
+	if (!handler) {
+		if (dst != CEC_ADDR_BROADCAST)
+			cec_feature_abort(msg, CEC_MSG_ABORT_REASON_OPCODE);
+		return;
+	}
+
+	if (!mode)
+		/* Not valid with this addressing, the spec says to ignore */
+		return;
+
+	len -= 2;
+	if (len < (lens & 0xf)) {
+		if (dst != CEC_ADDR_BROADCAST)
+			cec_feature_abort(msg, CEC_MSG_ABORT_REASON_OPERAND);
+		return;
+	}
+
+	/* Newer versions of the spec may add operands, ignore those */
+	if (len > (lens >> 4))
+		len = lens >> 4;
+
+	handler(msg, len);
+}
+
+/*
+ * Handle and release the oldest received message, returns false if
+ * there was none.
+ */
+CEC_PUBLIC bool cec_dispatch(void)
+{
+	const unsigned char *msg = cec_receive_buf + CEC_RECEIVE_BUF_HDR;
+	unsigned char hdr = msg[0];
+
+	if (!hdr)
+		return false;
+
+	/* Polls and damaged messages carry no opcode worth acting on */
+	if (!(hdr & (CEC_STATUS_NACK | CEC_STATUS_OVERRUN)) && hdr >= 2)
+		cec_dispatch_msg(msg + 1, hdr);
+
+	cec_receive_release();
+	return true;
+}
+#endif
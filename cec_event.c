@@ -0,0 +1,72 @@
+/*
+ * Event queue, lets the app find out what happened without polling
+ * cec_receive_buf, transmit_state and cec_addr_ready(). Events are posted
+ * from interrupt or cec_periodic() context and read by the app with
+ * cec_event_get(). Posting is atomic, reading is lock free as long as
+ * only one context reads.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#include <util/atomic.h>
+
+#ifdef CEC_EVENTS
+/* Ring of type, arg pairs, one entry is always left empty */
+static unsigned char cec_events[CEC_EVENTS + 1][2];
+static volatile unsigned char cec_event_head;
+static volatile unsigned char cec_event_tail;
+
+/* Events lost because the ring was full */
+unsigned char cec_events_dropped;
+
+#define cec_event_pending()	(cec_event_head != cec_event_tail)
+
+static void cec_event_post(unsigned char type, unsigned char arg)
+{
+	unsigned char head;
+	unsigned char next;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		head = cec_event_head;
+		next = head == CEC_EVENTS ? 0 : head + 1;
+		if (next == cec_event_tail)
+			cec_events_dropped++;
+		else {
+			cec_events[head][0] = type;
+			cec_events[head][1] = arg;
+			cec_event_head = next;
+		}
+	}
+}
+
+/* Returns the oldest event type and its argument, or CEC_EVENT_NONE */
+CEC_PUBLIC unsigned char cec_event_get(unsigned char *arg)
+{
+	unsigned char tail = cec_event_tail;
+	unsigned char type;
+
+	if (tail == cec_event_head)
+		return CEC_EVENT_NONE;
+
+	type = cec_events[tail][0];
+	*arg = cec_events[tail][1];
+	cec_event_tail = tail == CEC_EVENTS ? 0 : tail + 1;
+	return type;
+}
+#else
+#define cec_event_post(type, arg)	do {} while (0)
+#endif
@@ -0,0 +1,95 @@
+/*
+ * The few spots that need more than the register file. On AVR these are
+ * inline asm, with CEC_HOST defined they are plain C so the library can
+ * be built natively against the simulated registers in host/.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#ifndef _CEC_HAL_H_
+#define _CEC_HAL_H_
+
+#ifdef CEC_HOST
+
+/* Add, but cap at ~0xffff, same result as the AVR version */
+#define cec_add_cap(timer, delta) do {					\
+	unsigned long __sum = (unsigned long) (timer) + (delta);	\
+	(timer) = __sum > 0xffff ? (__sum & 0xff) | 0xff00 : __sum;	\
+} while (0)
+
+static inline unsigned char cec_swap(unsigned char n)
+{
+	return (n << 4) | (n >> 4);
+}
+
+#else
+
+/* Add, but cap at ~0xffff */
+#define cec_add_cap(timer, delta) asm(					\
+	"add	%A0, %A1\n"						\
+	"adc	%B0, %B1\n"						\
+	"brcc	1f\n"							\
+	"ldi	%B0, 0xff\n"						\
+	"1:\n"								\
+	: "=a"(timer)							\
+	: "r"(delta), "0"(timer)					\
+)
+
+/* Swap nibbles */
+static inline unsigned char cec_swap(unsigned char n)
+{
+	asm("swap %[n]" : [n] "+r"(n));
+	return n;
+}
+
+#endif
+
+/*
+ * Cycle probes for the simavr benchmarks in bench/. If CEC_BENCH_PROBES
+ * names a low I/O register, each probed section sets its bit there on
+ * the way in and clears it on the way out.
+ */
+#define CEC_PROBE_PERIODIC	0
+#define CEC_PROBE_TICK		1
+#define CEC_PROBE_ACK		2
+#define CEC_PROBE_RECEIVE_BIT	3
+#define CEC_PROBE_DISPATCH	4
+#define CEC_PROBE_PCINT		5
+#define CEC_PROBE_REFILL	6
+
+#define __CEC_STR(n)		#n
+#define CEC_STR(n)		__CEC_STR(n)
+
+#if defined(CEC_BENCH_PROBES) && !defined(CEC_HOST)
+#define cec_probe_enter(n) asm volatile("sbi %0, %1" : :		\
+		"I"(_SFR_IO_ADDR(CEC_BENCH_PROBES)), "I"(n))
+#define cec_probe_exit(n) asm volatile("cbi %0, %1" : :		\
+		"I"(_SFR_IO_ADDR(CEC_BENCH_PROBES)), "I"(n))
+
+/* Inside asm blocks, which need a [probe_io] "I"(CEC_PROBE_IO) input */
+#define CEC_PROBE_IO			_SFR_IO_ADDR(CEC_BENCH_PROBES)
+#define CEC_ASM_PROBE_ENTER(n)		"	sbi %[probe_io], " CEC_STR(n) "\n"
+#define CEC_ASM_PROBE_EXIT(n)		"	cbi %[probe_io], " CEC_STR(n) "\n"
+#else
+#define cec_probe_enter(n)		do {} while (0)
+#define cec_probe_exit(n)		do {} while (0)
+#define CEC_PROBE_IO			0
+#define CEC_ASM_PROBE_ENTER(n)		""
+#define CEC_ASM_PROBE_EXIT(n)		""
+#endif
+
+#endif
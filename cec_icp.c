@@ -0,0 +1,306 @@
+/*
+ * CEC transmit and receive with the Timer1 input capture and output
+ * compare hardware found on ATmega parts. CEC_PBIN must be the ICP1 pin
+ * and CEC_PBOUT the OC1B pin.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+
+#include <stdbool.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "div.h"
+
+#include "cec_spec.h"
+
+/* Timer1 runs free, it must not wrap during a full frame nack (24ms) */
+#define TCNT1_PRESCALER_IDEAL	DIV_ROUND_UP(F_CPU * 10 * CEC_PERIOD, \
+							65536000000)
+
+#if TCNT1_PRESCALER_IDEAL == 1
+#define TCNT1_PRESCALER 1UL
+#define TCNT1_PRESCALER_VAL 1
+#elif TCNT1_PRESCALER_IDEAL <= 8
+#define TCNT1_PRESCALER 8UL
+#define TCNT1_PRESCALER_VAL 2
+#elif TCNT1_PRESCALER_IDEAL <= 64
+#define TCNT1_PRESCALER 64UL
+#define TCNT1_PRESCALER_VAL 3
+#else
+#error "Could not find valid Timer1 prescaler"
+#endif
+
+#define US_TO_CEC_JIFFIES(n)	DIV_ROUND((n) * (unsigned long long) F_CPU, \
+					TCNT1_PRESCALER * 1000000)
+
+/* Output compare modes for OC1B, high on OC1B pulls the CEC line low */
+#define ICP_COM_DRIVE		(_BV(COM1B1) | _BV(COM1B0))
+#define ICP_COM_FLOAT		_BV(COM1B1)
+
+enum {
+	XMIT_IDLE,
+	XMIT_ACK,		/* Acking or nacking, float on match */
+	XMIT_START_LOW,
+	XMIT_BIT_LOW,
+	XMIT_BIT_HIGH,
+};
+
+/* What the next compare A match is for */
+enum {
+	ICP_SAMPLE,
+	ICP_TIMEOUT,
+	ICP_IDLE,
+};
+
+/* Timer1 stamps */
+static unsigned short icp_fall;
+static unsigned short icp_period;
+static unsigned char icp_phase;
+static unsigned char icp_idle_frames;
+static bool icp_sample;
+
+/* Start of the bit being transmitted */
+static unsigned short xmit_time;
+static unsigned char xmit_state;
+static bool xmit_last;
+
+/* Drive or float OC1B now, and do the opposite at time */
+static void icp_drive(unsigned short time, bool low)
+{
+	TCCR1A = low ? ICP_COM_DRIVE : ICP_COM_FLOAT;
+	TCCR1C = _BV(FOC1B);
+	OCR1B = time;
+	TCCR1A = low ? ICP_COM_FLOAT : ICP_COM_DRIVE;
+	TIFR1 = _BV(OCF1B);
+	TIMSK1 |= _BV(OCIE1B);
+}
+
+/* Change OC1B at time */
+static void icp_schedule(unsigned short time, bool low)
+{
+	OCR1B = time;
+	TCCR1A = low ? ICP_COM_DRIVE : ICP_COM_FLOAT;
+}
+
+static void cec_receive_nack_frame(void)
+{
+	/* We lost sync and don't know where to nack, just blast the line */
+	icp_drive(TCNT1 + US_TO_CEC_JIFFIES(10 * CEC_PERIOD), true);
+	xmit_state = XMIT_ACK;
+}
+
+static void cec_transmit_abort(void)
+{
+	if (xmit_state > XMIT_ACK) {
+		TIMSK1 &= ~_BV(OCIE1B);
+		TCCR1A = ICP_COM_FLOAT;
+		TCCR1C = _BV(FOC1B);
+		xmit_state = XMIT_IDLE;
+	}
+
+	cec_transmit_finish_abort();
+}
+
+static void xmit_start(void)
+{
+	cec_transmit_start(icp_idle_frames);
+
+	xmit_time = TCNT1;
+	icp_drive(xmit_time + US_TO_CEC_JIFFIES(CEC_START_LOW), true);
+	xmit_time += US_TO_CEC_JIFFIES(CEC_START_HIGH);
+	xmit_state = XMIT_START_LOW;
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+	bool bit;
+
+	switch (xmit_state) {
+	case XMIT_ACK:
+		/* Hardware already let go of the line */
+		TIMSK1 &= ~_BV(OCIE1B);
+		xmit_state = XMIT_IDLE;
+		break;
+
+	case XMIT_BIT_LOW:
+		if (xmit_last) {
+			/* Ack bit is out, receive side reports how it went */
+			TIMSK1 &= ~_BV(OCIE1B);
+			xmit_state = XMIT_IDLE;
+			break;
+		}
+		xmit_time += US_TO_CEC_JIFFIES(CEC_PERIOD);
+
+		/* Fall through */
+	case XMIT_START_LOW:
+		/* Line is high, schedule the start of the next bit */
+		icp_schedule(xmit_time, true);
+		xmit_state = XMIT_BIT_HIGH;
+		break;
+
+	case XMIT_BIT_HIGH:
+		/* Line just went low, schedule the end of the low period */
+		bit = cec_transmit_get_bit();
+		xmit_last = transmit_state == TRANSMIT_WAIT_FOR_ACK;
+		icp_schedule(xmit_time + (bit ? US_TO_CEC_JIFFIES(CEC_1) :
+					US_TO_CEC_JIFFIES(CEC_0)), false);
+		xmit_state = XMIT_BIT_LOW;
+		break;
+	}
+}
+
+ISR(TIMER1_CAPT_vect)
+{
+	unsigned short ts = ICR1;
+	unsigned short low;
+	bool fall;
+
+	/* The input is inverted, a rising capture is a falling CEC edge */
+	fall = TCCR1B & _BV(ICES1);
+
+	/* Catch the opposite edge next, going by the level */
+	if (cec_input_state())
+		TCCR1B |= _BV(ICES1);
+	else
+		TCCR1B &= ~_BV(ICES1);
+	TIFR1 = _BV(ICF1);
+
+	if (!fall) {
+		/* Rising edge */
+		low = ts - icp_fall;
+		if (low > US_TO_CEC_JIFFIES(CEC_START_LOW_EARLY) &&
+		    low < US_TO_CEC_JIFFIES(CEC_START_LOW_LATE)) {
+			icp_period = US_TO_CEC_JIFFIES(CEC_START_HIGH_EARLY);
+			icp_sample = false;
+			/* Start */
+			cec_receive_start();
+
+			/* Wait for the first bit */
+			OCR1A = icp_fall + icp_period + US_TO_CEC_JIFFIES(800);
+			TIFR1 = _BV(OCF1A);
+			icp_phase = ICP_TIMEOUT;
+		}
+		return;
+	}
+
+	/* Falling edge */
+	if (cec_receive_flags) {
+		if ((unsigned short) (ts - icp_fall) < icp_period)
+			/* Error */
+			cec_receive_error(CEC_ERR_LOW_DRIVE);
+		else {
+			if ((cec_receive_flags & CEC_RECV_DO_ACK) &&
+			    !(cec_receive_flags & CEC_RECV_BITS_EOM) &&
+			    xmit_state == XMIT_IDLE) {
+				/* Hold the ack bit for a 0 */
+				icp_drive(ts + US_TO_CEC_JIFFIES(CEC_0), true);
+				xmit_state = XMIT_ACK;
+			}
+			icp_sample = true;
+		}
+	}
+	icp_period = US_TO_CEC_JIFFIES(CEC_T7_EARLY_END);
+	icp_fall = ts;
+
+	OCR1A = ts + US_TO_CEC_JIFFIES(CEC_NOM_SAMPLE);
+	TIFR1 = _BV(OCF1A);
+	icp_phase = ICP_SAMPLE;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+	switch (icp_phase) {
+	case ICP_SAMPLE:
+		if (icp_sample && cec_receive_flags) {
+			icp_sample = false;
+			cec_receive_bit(cec_input_state());
+		}
+		OCR1A = icp_fall + icp_period + US_TO_CEC_JIFFIES(800);
+		icp_phase = ICP_TIMEOUT;
+		break;
+
+	case ICP_TIMEOUT:
+		if (cec_receive_flags)
+			/* We've gone 600uS without an expected transition */
+			cec_receive_error(CEC_ERR_NO_EOM);
+		icp_idle_frames = 0;
+		OCR1A += US_TO_CEC_JIFFIES(CEC_PERIOD);
+		icp_phase = ICP_IDLE;
+		break;
+
+	case ICP_IDLE:
+		OCR1A += US_TO_CEC_JIFFIES(CEC_PERIOD);
+		if (!cec_input_state()) {
+			/* Held low, not signal free */
+			icp_idle_frames = 0;
+			break;
+		}
+
+		if (icp_idle_frames != 0xff)
+			icp_idle_frames++;
+
+		if ((transmit_state & TRANSMIT_PEND) &&
+				xmit_state == XMIT_IDLE &&
+				icp_idle_frames >= needed_idle_frames)
+			xmit_start();
+		break;
+	}
+}
+
+static void cec_receive_periodic(unsigned int delta)
+{
+}
+
+static void cec_transmit_periodic(unsigned int delta)
+{
+}
+
+static void cec_transmit_init_hw(void)
+{
+	/* Let go of the line */
+	TCCR1A = ICP_COM_FLOAT;
+	TCCR1C = _BV(FOC1B);
+	xmit_state = XMIT_IDLE;
+}
+
+static void cec_transmit_halt_hw(void)
+{
+	TIMSK1 &= ~_BV(OCIE1B);
+	cec_transmit_init_hw();
+}
+
+static void cec_receive_halt_hw(void)
+{
+	TIMSK1 &= ~(_BV(ICIE1) | _BV(OCIE1A));
+}
+
+static void cec_receive_init(void)
+{
+	icp_phase = ICP_IDLE;
+	icp_idle_frames = 0;
+	icp_period = 0;
+
+	/* Normal mode, noise canceler on, start the clock */
+	TCCR1B = _BV(ICNC1) | TCNT1_PRESCALER_VAL |
+				(cec_input_state() ? _BV(ICES1) : 0);
+	OCR1A = TCNT1 + US_TO_CEC_JIFFIES(CEC_PERIOD);
+	TIFR1 = _BV(ICF1) | _BV(OCF1A);
+	TIMSK1 |= _BV(ICIE1) | _BV(OCIE1A);
+}
@@ -0,0 +1,257 @@
+/*
+ * Several independent CEC buses from one build. Define CEC_INSTANCE to a
+ * prefix along with the pin macros before each include of cec.c, every
+ * global and function of that copy of the library is then named
+ * <prefix>_<name>, so hdmi1 gets hdmi1_cec_periodic, hdmi1_transmit_buf
+ * and so on. The names are bound when they are used, the plain names
+ * refer to whichever instance CEC_INSTANCE names at that point.
+ *
+ * Only the polled drivers, cec_receive_min and cec_transmit_raw, can be
+ * instanced, the others own a fixed timer or interrupt vector. Without
+ * CEC_INSTANCE nothing here has any effect.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#if defined(CEC_INSTANCE) && !defined(_CEC_INSTANCE_H_)
+#define _CEC_INSTANCE_H_
+
+#include "cec_config.h"
+
+#if defined(CEC_USI) || defined(CEC_ICP) || \
+    defined(CEC_RECEIVE_PCINT) || defined(CEC_TRANSMIT_PWM)
+#error "CEC_INSTANCE needs the cec_receive_min and cec_transmit_raw drivers"
+#endif
+
+#if defined(CEC_TRANSMIT_STATE_REG) || defined(CEC_RECEIVE_FLAGS_REG) || \
+    defined(CEC_NEEDED_IDLE_FRAMES_REG) || defined(CEC_LOGICAL_ADDRESS_REG)
+#error "Register variables can't be instanced"
+#endif
+
+#define __CEC_NAME(p, n)	p ## _ ## n
+#define _CEC_NAME(p, n)		__CEC_NAME(p, n)
+#define CEC_NAME(n)		_CEC_NAME(CEC_INSTANCE, n)
+
+/* cec.c */
+#define cec_init			CEC_NAME(cec_init)
+#define cec_periodic			CEC_NAME(cec_periodic)
+#define cec_halt			CEC_NAME(cec_halt)
+
+/* cec_event.c */
+#ifdef CEC_EVENTS
+#define cec_events			CEC_NAME(cec_events)
+#define cec_event_head			CEC_NAME(cec_event_head)
+#define cec_event_tail			CEC_NAME(cec_event_tail)
+#define cec_events_dropped		CEC_NAME(cec_events_dropped)
+#define cec_event_post			CEC_NAME(cec_event_post)
+#define cec_event_get			CEC_NAME(cec_event_get)
+#endif
+
+/* cec_timer.c */
+#if defined(CEC_JIFFIES) || defined(CEC_TIMERS)
+#define cec_jiffies			CEC_NAME(cec_jiffies)
+#define jiffies				CEC_NAME(jiffies)
+#define cec_timer_periodic		CEC_NAME(cec_timer_periodic)
+#endif
+#ifdef CEC_TIMERS
+#define cec_timers			CEC_NAME(cec_timers)
+#define cec_timer_wheel			CEC_NAME(cec_timer_wheel)
+#define cec_timer_now			CEC_NAME(cec_timer_now)
+#define cec_timer_frac			CEC_NAME(cec_timer_frac)
+#define cec_timer_stop			CEC_NAME(cec_timer_stop)
+#define cec_timer_link			CEC_NAME(cec_timer_link)
+#define cec_timer_start			CEC_NAME(cec_timer_start)
+#define cec_timer_tick			CEC_NAME(cec_timer_tick)
+#endif
+
+/* cec_transmit.c */
+#define transmit_buf			CEC_NAME(transmit_buf)
+#define transmit_buf_end		CEC_NAME(transmit_buf_end)
+#define transmit_buf_bit		CEC_NAME(transmit_buf_bit)
+#define transmit_buf_pos		CEC_NAME(transmit_buf_pos)
+#define transmit_last_bit		CEC_NAME(transmit_last_bit)
+#ifdef CEC_ERR_STATS
+#define transmit_state_buf		CEC_NAME(transmit_state_buf)
+#else
+#define transmit_state			CEC_NAME(transmit_state)
+#endif
+#define transmit_retries		CEC_NAME(transmit_retries)
+#define transmit_last_err		CEC_NAME(transmit_last_err)
+#define transmit_queue			CEC_NAME(transmit_queue)
+#define transmit_queue_head		CEC_NAME(transmit_queue_head)
+#define transmit_queue_tail		CEC_NAME(transmit_queue_tail)
+#define transmit_entry			CEC_NAME(transmit_entry)
+#define transmit_entry_prio		CEC_NAME(transmit_entry_prio)
+#define transmit_burst			CEC_NAME(transmit_burst)
+#define transmit_burst_idle		CEC_NAME(transmit_burst_idle)
+#define needed_idle_frames		CEC_NAME(needed_idle_frames)
+#define needed_idle_time		CEC_NAME(needed_idle_time)
+#define cec_transmit_alloc		CEC_NAME(cec_transmit_alloc)
+#define cec_transmit_commit		CEC_NAME(cec_transmit_commit)
+#define cec_transmit_next		CEC_NAME(cec_transmit_next)
+#define cec_transmit_load		CEC_NAME(cec_transmit_load)
+#define cec_transmit_release_held	CEC_NAME(cec_transmit_release_held)
+#define cec_transmit_done		CEC_NAME(cec_transmit_done)
+#define cec_transmit_on_error		CEC_NAME(cec_transmit_on_error)
+#define cec_transmit_finish_abort	CEC_NAME(cec_transmit_finish_abort)
+#define cec_transmit_halt		CEC_NAME(cec_transmit_halt)
+#define cec_check_tx_bit		CEC_NAME(cec_check_tx_bit)
+#define cec_transmit_receive_ack	CEC_NAME(cec_transmit_receive_ack)
+#define cec_transmit_prepare		CEC_NAME(cec_transmit_prepare)
+#define cec_transmit_start		CEC_NAME(cec_transmit_start)
+#define cec_transmit_get_bit		CEC_NAME(cec_transmit_get_bit)
+#define cec_transmit_init		CEC_NAME(cec_transmit_init)
+
+/* cec_receive.c */
+#define cec_receive_slots		CEC_NAME(cec_receive_slots)
+#if defined(CEC_RECEIVE_SLOTS) && CEC_RECEIVE_SLOTS > 1
+#define cec_receive_head		CEC_NAME(cec_receive_head)
+#define cec_receive_tail		CEC_NAME(cec_receive_tail)
+#endif
+#define cec_receive_dropped		CEC_NAME(cec_receive_dropped)
+#define cec_receive_byte		CEC_NAME(cec_receive_byte)
+#define cec_receive_pos			CEC_NAME(cec_receive_pos)
+#define cec_receive_flags		CEC_NAME(cec_receive_flags)
+#define cec_receive_error		CEC_NAME(cec_receive_error)
+#define cec_receive_halt		CEC_NAME(cec_receive_halt)
+#define cec_receive_release		CEC_NAME(cec_receive_release)
+#define cec_receive_start		CEC_NAME(cec_receive_start)
+#define cec_receive_bit			CEC_NAME(cec_receive_bit)
+#ifdef CEC_RECEIVE_EARLY
+#define cec_receive_early_sent		CEC_NAME(cec_receive_early_sent)
+#define cec_receive_early_done		CEC_NAME(cec_receive_early_done)
+#endif
+#ifdef CEC_RECEIVE_FILTER
+#define cec_filter_src			CEC_NAME(cec_filter_src)
+#define cec_filter_dst			CEC_NAME(cec_filter_dst)
+#define cec_filter_opcodes		CEC_NAME(cec_filter_opcodes)
+#define cec_filter_own			CEC_NAME(cec_filter_own)
+#define cec_receive_filtered		CEC_NAME(cec_receive_filtered)
+#define cec_receive_delivered		CEC_NAME(cec_receive_delivered)
+#endif
+
+/* cec_respond.c */
+#ifdef CEC_RESPONDER
+#define cec_respond_info		CEC_NAME(cec_respond_info)
+#define cec_respond_osd_name		CEC_NAME(cec_respond_osd_name)
+#define cec_physical_address		CEC_NAME(cec_physical_address)
+#define cec_power_status		CEC_NAME(cec_power_status)
+#define cec_respond_queue		CEC_NAME(cec_respond_queue)
+#define cec_respond_head		CEC_NAME(cec_respond_head)
+#define cec_respond_tail		CEC_NAME(cec_respond_tail)
+#define cec_respond_rx			CEC_NAME(cec_respond_rx)
+#define cec_respond_periodic		CEC_NAME(cec_respond_periodic)
+#define cec_respond_init		CEC_NAME(cec_respond_init)
+#endif
+
+/* cec_topo.c */
+#ifdef CEC_TOPOLOGY
+#define cec_topo			CEC_NAME(cec_topo)
+#define cec_topo_present		CEC_NAME(cec_topo_present)
+#define cec_topo_fresh			CEC_NAME(cec_topo_fresh)
+#define cec_topo_buf			CEC_NAME(cec_topo_buf)
+#define cec_topo_now			CEC_NAME(cec_topo_now)
+#define cec_topo_frac			CEC_NAME(cec_topo_frac)
+#define cec_topo_clear			CEC_NAME(cec_topo_clear)
+#define cec_topo_seen			CEC_NAME(cec_topo_seen)
+#define cec_topo_gone			CEC_NAME(cec_topo_gone)
+#define cec_topo_byte			CEC_NAME(cec_topo_byte)
+#define cec_topo_rx			CEC_NAME(cec_topo_rx)
+#define cec_topo_get			CEC_NAME(cec_topo_get)
+#define cec_topo_devices		CEC_NAME(cec_topo_devices)
+#define cec_topo_age			CEC_NAME(cec_topo_age)
+#define cec_topo_forget			CEC_NAME(cec_topo_forget)
+#define cec_topo_periodic		CEC_NAME(cec_topo_periodic)
+#define cec_topo_init			CEC_NAME(cec_topo_init)
+#endif
+
+/* cec_dispatch.c */
+#ifdef CEC_DISPATCH
+#define cec_dispatch_index		CEC_NAME(cec_dispatch_index)
+#define cec_dispatch_table		CEC_NAME(cec_dispatch_table)
+#define cec_dispatch_msg		CEC_NAME(cec_dispatch_msg)
+#define cec_dispatch			CEC_NAME(cec_dispatch)
+#define cec_feature_abort		CEC_NAME(cec_feature_abort)
+#endif
+
+/* cec_receive_min.c, cec_receive_pcint.c uses the same state names */
+#define receive_frame_period		CEC_NAME(receive_frame_period)
+#define receive_frame_timer		CEC_NAME(receive_frame_timer)
+#define receive_frame_ack_done		CEC_NAME(receive_frame_ack_done)
+#define receive_last_state		CEC_NAME(receive_last_state)
+#define receive_sample			CEC_NAME(receive_sample)
+#define cec_receive_nack_frame		CEC_NAME(cec_receive_nack_frame)
+#define cec_receive_periodic		CEC_NAME(cec_receive_periodic)
+#define cec_receive_halt_hw		CEC_NAME(cec_receive_halt_hw)
+#define cec_receive_init		CEC_NAME(cec_receive_init)
+
+/* cec_transmit_raw.c */
+#define transmit_timer			CEC_NAME(transmit_timer)
+#define transmit_low_time		CEC_NAME(transmit_low_time)
+#define xmit_state			CEC_NAME(xmit_state)
+#define xmit_last			CEC_NAME(xmit_last)
+#define xmit_next_bit			CEC_NAME(xmit_next_bit)
+#define cec_transmit_abort		CEC_NAME(cec_transmit_abort)
+#define cec_transmit_periodic		CEC_NAME(cec_transmit_periodic)
+#define cec_transmit_init_hw		CEC_NAME(cec_transmit_init_hw)
+#define cec_transmit_halt_hw		CEC_NAME(cec_transmit_halt_hw)
+
+/* cec_addr_*.c */
+#define logical_address			CEC_NAME(logical_address)
+#define logical_addresses		CEC_NAME(logical_addresses)
+#define cec_dev_idx			CEC_NAME(cec_dev_idx)
+#define cec_dev_addrs			CEC_NAME(cec_dev_addrs)
+#define cec_addr_poll			CEC_NAME(cec_addr_poll)
+#define cec_addr_set			CEC_NAME(cec_addr_set)
+#define cec_addr_build			CEC_NAME(cec_addr_build)
+#define cec_addr_ready			CEC_NAME(cec_addr_ready)
+#define cec_addr_match			CEC_NAME(cec_addr_match)
+#define cec_addr_init			CEC_NAME(cec_addr_init)
+#define cec_addr_periodic		CEC_NAME(cec_addr_periodic)
+#ifdef CEC_ADDR_CACHE
+#define cec_addr_cache_slot		CEC_NAME(cec_addr_cache_slot)
+#define cec_addr_cache_seq		CEC_NAME(cec_addr_cache_seq)
+#define cec_addr_cache_busy		CEC_NAME(cec_addr_cache_busy)
+#define cec_addr_cache_write		CEC_NAME(cec_addr_cache_write)
+#define cec_addr_polled			CEC_NAME(cec_addr_polled)
+#define cec_addr_busy			CEC_NAME(cec_addr_busy)
+#define cec_dev_order			CEC_NAME(cec_dev_order)
+#define cec_addr_cache_load		CEC_NAME(cec_addr_cache_load)
+#define cec_addr_cache_poll		CEC_NAME(cec_addr_cache_poll)
+#define cec_addr_cache_store		CEC_NAME(cec_addr_cache_store)
+#define cec_addr_cache_periodic		CEC_NAME(cec_addr_cache_periodic)
+#endif
+#ifdef CEC_DEV_TYPES
+#define cec_dev_types			CEC_NAME(cec_dev_types)
+#define cec_dev_logical			CEC_NAME(cec_dev_logical)
+#define cec_addr_pending		CEC_NAME(cec_addr_pending)
+#define cec_addr_cur			CEC_NAME(cec_addr_cur)
+#define cec_addr_turn			CEC_NAME(cec_addr_turn)
+#define cec_addr_type_idx		CEC_NAME(cec_addr_type_idx)
+#define cec_addr_dev_type		CEC_NAME(cec_addr_dev_type)
+#define cec_addr_next			CEC_NAME(cec_addr_next)
+#define cec_addr_poll_done		CEC_NAME(cec_addr_poll_done)
+#endif
+#ifdef CEC_ADDR_CONFLICT
+#define cec_addr_polling		CEC_NAME(cec_addr_polling)
+#define cec_addr_conflicted		CEC_NAME(cec_addr_conflicted)
+#define cec_addr_settled		CEC_NAME(cec_addr_settled)
+#define cec_addr_conflict		CEC_NAME(cec_addr_conflict)
+#define cec_addr_recheck		CEC_NAME(cec_addr_recheck)
+#endif
+
+#endif
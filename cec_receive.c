@@ -18,10 +18,13 @@
  */
 #include <stdbool.h>
 
+#include <stddef.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#ifndef CEC_USI
+#include "cec_spec.h"
+
+#ifndef CEC_IDLE_FRAMES
 #include "time.h"
 #endif
 
@@ -45,12 +48,92 @@
 
 static void cec_receive_halt_hw(void);
 
+#ifndef CEC_RECEIVE_SLOTS
+#define CEC_RECEIVE_SLOTS 1
+#endif
+
 /*
- * Output buffer. CEC_RECEIVE_BUF_HDR lets the app put bytes at the head
+ * Output ring. CEC_RECEIVE_BUF_HDR lets the app put bytes at the head
  * of the that we don't touch. This can allow the user application to
  * easily send out the buffer with an attached header.
+ *
+ * A slot belongs to the receive engine while its header byte is zero and
+ * to the user app once it is non-zero. The engine fills slots at
+ * cec_receive_head, the app drains them at cec_receive_tail.
+ */
+unsigned char cec_receive_slots[CEC_RECEIVE_SLOTS][CEC_BUFFER_SIZE+CEC_RECEIVE_BUF_HDR+1];
+
+#if CEC_RECEIVE_SLOTS > 1
+static unsigned char cec_receive_head;
+unsigned char cec_receive_tail;
+#else
+#define cec_receive_head 0
+#define cec_receive_tail 0
+#endif
+
+/* Oldest message not yet released by the app */
+#define cec_receive_buf (cec_receive_slots[cec_receive_tail])
+
+/* Messages for us refused because every slot was in use */
+unsigned char cec_receive_dropped;
+
+#ifdef CEC_RECEIVE_FILTER
+/*
+ * Messages are only stored if the initiator, the destination and the
+ * opcode all have their bit set. Everything is let through at first.
  */
-unsigned char cec_receive_buf[CEC_BUFFER_SIZE+CEC_RECEIVE_BUF_HDR+1];
+unsigned char cec_filter_src[2] = { 0xff, 0xff };
+unsigned char cec_filter_dst[2] = { 0xff, 0xff };	/* 15 is broadcast */
+unsigned char cec_filter_opcodes[32] = { [0 ... 31] = 0xff };
+
+/* Skip the frames we send ourselves */
+bool cec_filter_own;
+
+/* Our transmitter still being busy once the header is in means it's ours */
+#if CEC_MONITOR
+#define cec_filter_is_own()		false
+#else
+#define cec_filter_is_own()		(cec_filter_own && \
+					transmit_state > TRANSMIT_AGAIN)
+#endif
+
+#define cec_filter_test(map, n)		((map)[(n) >> 3] & _BV((n) & 7))
+#define cec_filter_allow(map, n)	((map)[(n) >> 3] |= _BV((n) & 7))
+#define cec_filter_block(map, n)	((map)[(n) >> 3] &= ~_BV((n) & 7))
+
+/* Messages kept out of the slots by the filter, and messages stored */
+unsigned short cec_receive_filtered;
+unsigned short cec_receive_delivered;
+
+#define cec_filter_opcode(op)		cec_filter_test(cec_filter_opcodes, op)
+#else
+#define cec_filter_opcode(op)		true
+#endif
+
+#ifdef CEC_RECEIVE_EARLY
+/*
+ * The app defines CEC_RECEIVE_EARLY(hdr, opcode) to get a look at a frame
+ * as soon as its opcode is in, and optionally CEC_RECEIVE_EARLY_DONE(status)
+ * to hear how it ended. Status is the receive header byte if the frame
+ * got stored, 0 if it didn't.
+ */
+#ifndef CEC_RECEIVE_EARLY_DONE
+#define CEC_RECEIVE_EARLY_DONE(status)	do {} while (0)
+#endif
+
+/* The app has been told about the frame in progress */
+static bool cec_receive_early_sent;
+
+static void cec_receive_early_done(unsigned char status)
+{
+	if (cec_receive_early_sent) {
+		cec_receive_early_sent = false;
+		CEC_RECEIVE_EARLY_DONE(status);
+	}
+}
+#else
+#define cec_receive_early_done(status)	do {} while (0)
+#endif
 
 /* Internal state */
 static unsigned char cec_receive_byte;
@@ -63,6 +146,16 @@ static unsigned char cec_receive_flags;
 
 /* Callbacks or implementors */
 static void cec_receive_nack_frame(void);
+#ifdef CEC_RESPONDER
+static bool cec_respond_rx(unsigned char hdr, unsigned char opcode);
+#endif
+#ifdef CEC_ADDR_CONFLICT
+static void cec_addr_conflict(void);
+#endif
+#ifdef CEC_TOPOLOGY
+static void cec_topo_byte(unsigned char pos, unsigned char byte);
+static void cec_topo_rx(unsigned char len, bool nacked);
+#endif
 
 static void cec_receive_error(unsigned char err)
 {
@@ -75,6 +168,8 @@ static void cec_receive_error(unsigned char err)
 		cec_receive_nack_frame();
 
 	cec_receive_flags = 0;
+	cec_receive_early_done(0);
+	cec_event_post(CEC_EVENT_BUS_ERROR, err);
 
 	/* Tell the transmit side something went wrong */
 	cec_transmit_on_error(err);
@@ -82,10 +177,44 @@ static void cec_receive_error(unsigned char err)
 
 static void cec_receive_halt(void)
 {
+#if CEC_RECEIVE_SLOTS > 1
+	unsigned char i;
+
+	for (i = 0; i < CEC_RECEIVE_SLOTS; i++)
+		cec_receive_slots[i][CEC_RECEIVE_BUF_HDR] = 0;
+	cec_receive_head = 0;
+	cec_receive_tail = 0;
+#else
 	cec_receive_buf[CEC_RECEIVE_BUF_HDR] = 0;
+#endif
 	cec_receive_halt_hw();
 }
 
+/*
+ * App is done with the message in cec_receive_buf. This hands back one
+ * slot, to throw away everything pending call it until the header byte
+ * of cec_receive_buf reads 0.
+ */
+CEC_PUBLIC void cec_receive_release(void)
+{
+#if CEC_RECEIVE_SLOTS > 1
+	unsigned char tail = cec_receive_tail;
+
+	if (!cec_receive_slots[tail][CEC_RECEIVE_BUF_HDR])
+		/* Nothing pending */
+		return;
+
+	/*
+	 * Move on before handing the slot back, if the ring was full the
+	 * engine may start filling it right away.
+	 */
+	cec_receive_tail = tail + 1 == CEC_RECEIVE_SLOTS ? 0 : tail + 1;
+	cec_receive_slots[tail][CEC_RECEIVE_BUF_HDR] = 0;
+#else
+	cec_receive_buf[CEC_RECEIVE_BUF_HDR] = 0;
+#endif
+}
+
 /* Underlying hardware got us a start frame */
 static void cec_receive_start(void)
 {
@@ -94,12 +223,15 @@ static void cec_receive_start(void)
 	cec_receive_byte = _BV(0);
 	cec_receive_flags = CEC_RECV_ACTIVE | CEC_RECV_BITS_EOM;
 
+	/* Previous frame was cut short */
+	cec_receive_early_done(0);
+
 	/*
 	 * Consider someone else present initiator, if we are
 	 * transmitting, this will get reset.
 	 */
 #if !CEC_MONITOR
-#ifdef CEC_USI
+#ifdef CEC_IDLE_FRAMES
 	needed_idle_frames = CEC_NEW_PERIOD_WAIT;
 #else
 	needed_idle_time = US_TO_JIFFIES_UP(CEC_NEW_PERIOD_WAIT * CEC_PERIOD);
@@ -120,6 +252,8 @@ static void cec_receive_bit(bool bit)
 	unsigned char flags = cec_receive_flags;
 	unsigned char receive_pos = cec_receive_pos;
 
+	cec_probe_enter(CEC_PROBE_RECEIVE_BIT);
+
 	if (flags & CEC_RECV_BITS_EOM) {
 		/* We are receiving either the data byte, or the EOM */
 
@@ -141,6 +275,10 @@ static void cec_receive_bit(bool bit)
 
 			if (done) {
 				bool nack = false;
+#ifdef CEC_TOPOLOGY
+				/* Whether or not it gets stored */
+				cec_topo_byte(receive_pos, receive_byte);
+#endif
 				if (!receive_pos) {
 					/*
 					 * First byte, we now have the target
@@ -153,13 +291,42 @@ static void cec_receive_bit(bool bit)
 					else if (cec_addr_match(addr))
 						flags |= CEC_RECV_DO_ACK;
 
+#ifdef CEC_ADDR_CONFLICT
+					/*
+					 * Sent from our address, but not by
+					 * us. Unregistered can be shared. A
+					 * poll is someone else looking, we
+					 * ack it and they move on.
+					 */
+					if (transmit_state <= TRANSMIT_AGAIN &&
+					    (receive_byte >> 4) != CEC_ADDR_UNREGISTERED &&
+					    (receive_byte >> 4) != addr &&
+					    cec_addr_match(receive_byte >> 4))
+						cec_addr_conflict();
+#endif
+
+#ifdef CEC_RECEIVE_FILTER
+					/*
+					 * Not wanted, ack it as usual but
+					 * don't store it.
+					 */
+					if (!cec_filter_test(cec_filter_src, receive_byte >> 4) ||
+					    !cec_filter_test(cec_filter_dst, addr) ||
+					    cec_filter_is_own()) {
+						flags |= CEC_RECV_IGNORE;
+						cec_receive_filtered++;
+					} else
+#endif
 					/*
-					 * There is already a message pending,
+					 * Every slot has a message pending,
 					 * don't ack anything new.
 					 */
-					if (cec_receive_buf[CEC_RECEIVE_BUF_HDR]) {
+					if (cec_receive_slots[cec_receive_head][CEC_RECEIVE_BUF_HDR]) {
 						nack = true;
 						flags |= CEC_RECV_IGNORE;
+						/* Only count what we'd have acked */
+						if (flags & (CEC_RECV_DO_ACK | CEC_RECV_BCAST))
+							cec_receive_dropped++;
 					}
 
 				} else if (receive_pos == CEC_BUFFER_SIZE) {
@@ -178,8 +345,18 @@ static void cec_receive_bit(bool bit)
 					else
 						/* Follower: We can't ack */
 						flags &= ~CEC_RECV_DO_ACK;
-				} else if (!(flags & (CEC_RECV_IGNORE|CEC_RECV_OVERRUN)))
-					cec_receive_buf[receive_pos + 1 + CEC_RECEIVE_BUF_HDR] = receive_byte;
+				} else if (!(flags & (CEC_RECV_IGNORE|CEC_RECV_OVERRUN))) {
+					cec_receive_slots[cec_receive_head][receive_pos + 1 + CEC_RECEIVE_BUF_HDR] = receive_byte;
+#ifdef CEC_RECEIVE_EARLY
+					/* Header and opcode are in, app can get going */
+					if (receive_pos == 1 &&
+					    cec_filter_opcode(receive_byte)) {
+						cec_receive_early_sent = true;
+						CEC_RECEIVE_EARLY(cec_receive_slots[cec_receive_head][CEC_RECEIVE_BUF_HDR + 1],
+							receive_byte);
+					}
+#endif
+				}
 				cec_receive_pos = receive_pos + 1;
 				receive_byte = 0;
 			}
@@ -209,11 +386,46 @@ static void cec_receive_bit(bool bit)
 		if (!bit || (flags & CEC_RECV_EOM)) {
 			/* We are done */
 
+#ifdef CEC_TOPOLOGY
+			/* Before the responder or filter can drop it */
+			cec_topo_rx(receive_pos, flags & CEC_RECV_NACKED);
+#endif
+
+#ifdef CEC_RESPONDER
+			/* Acked query for us, the responder may answer it */
+			if (receive_pos == 2 && (flags & (CEC_RECV_DO_ACK |
+			    CEC_RECV_BCAST | CEC_RECV_NACKED |
+			    CEC_RECV_IGNORE)) == CEC_RECV_DO_ACK &&
+			    cec_respond_rx(cec_receive_slots[cec_receive_head][CEC_RECEIVE_BUF_HDR + 1],
+				cec_receive_slots[cec_receive_head][CEC_RECEIVE_BUF_HDR + 2]))
+				flags |= CEC_RECV_IGNORE;
+#endif
+
+#ifdef CEC_RECEIVE_FILTER
+			/* The responder has had its look, now the opcode */
+			if (!(flags & CEC_RECV_IGNORE) && receive_pos > 1 &&
+			    !cec_filter_opcode(cec_receive_slots[cec_receive_head][CEC_RECEIVE_BUF_HDR + 2])) {
+				flags |= CEC_RECV_IGNORE;
+				cec_receive_filtered++;
+			}
+#endif
+
 			if (!(flags & CEC_RECV_IGNORE)) {
-				cec_receive_buf[CEC_RECEIVE_BUF_HDR] =
-					receive_pos | (flags & (
+				unsigned char hdr = receive_pos | (flags & (
 					CEC_STATUS_NACK | CEC_STATUS_OVERRUN));
-			}
+
+				cec_receive_slots[cec_receive_head][CEC_RECEIVE_BUF_HDR] = hdr;
+				cec_receive_early_done(hdr);
+				cec_event_post(CEC_EVENT_RX, hdr);
+#ifdef CEC_RECEIVE_FILTER
+				cec_receive_delivered++;
+#endif
+#if CEC_RECEIVE_SLOTS > 1
+				if (++cec_receive_head == CEC_RECEIVE_SLOTS)
+					cec_receive_head = 0;
+#endif
+			} else
+				cec_receive_early_done(0);
 
 			/* Ignore remainder of message (if any) */
 			flags = 0;
@@ -226,5 +438,6 @@ static void cec_receive_bit(bool bit)
 	}
 
 	cec_receive_flags = flags;
+	cec_probe_exit(CEC_PROBE_RECEIVE_BIT);
 }
 
@@ -23,8 +23,8 @@
 static unsigned int receive_frame_period;
 static unsigned int receive_frame_timer;
 static unsigned int receive_frame_ack_done;
-static bool last_state;
-static bool sample;
+static bool receive_last_state;
+static bool receive_sample;
 
 static void cec_receive_nack_frame(void)
 {
@@ -40,25 +40,16 @@ static void cec_receive_periodic(unsigned int delta)
 {
 	bool state;
 
-	/* Add, but cap at ~0xffff */
-	asm(
-		"add	%A0, %A1\n"
-		"adc	%B0, %B1\n"
-		"brcc	1f\n"
-		"ldi	%B0, 0xff\n"
-		"1:\n"
-		: "=a"(receive_frame_timer)
-		: "r"(delta), "0"(receive_frame_timer)
-	);
+	cec_add_cap(receive_frame_timer, delta);
 
 	state = cec_input_state();
-	if (sample && receive_frame_timer > US_TO_JIFFIES(CEC_T3)) {
-		sample = false;
+	if (receive_sample && receive_frame_timer > US_TO_JIFFIES(CEC_T3)) {
+		receive_sample = false;
 		if (receive_frame_timer > US_TO_JIFFIES_UP(CEC_T4))
 			/* Latency failure */
 			cec_receive_error(CEC_ERR_HW);
-		else
-			/* Sample our bit */
+		else if (cec_receive_flags)
+			/* Sample our bit, unless the frame was dropped */
 			cec_receive_bit(state);
 	}
 
@@ -66,7 +57,7 @@ static void cec_receive_periodic(unsigned int delta)
 		/* Done acking/nacking */
 		cec_receive_float();
 
-	if (state == last_state) {
+	if (state == receive_last_state) {
 		if (receive_frame_timer > receive_frame_period + (unsigned short) US_TO_JIFFIES_UP(800))
 			/* We've gone 600uS without an expected transition */
 			cec_receive_error(CEC_ERR_NO_EOM);
@@ -92,14 +83,14 @@ static void cec_receive_periodic(unsigned int delta)
 					receive_frame_ack_done =
 						US_TO_JIFFIES(CEC_T5_EARLY0);
 				}
-				sample = true;
+				receive_sample = true;
 			}
 		}
 		receive_frame_period = US_TO_JIFFIES_RND(CEC_T7_EARLY_END - 50);
 		receive_frame_timer = 0;
 	}
 
-	last_state = state;
+	receive_last_state = state;
 }
 
 static void cec_receive_halt_hw(void)
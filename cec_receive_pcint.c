@@ -0,0 +1,256 @@
+/*
+ * Pin change CEC receive driver. A pin change interrupt stamps each edge
+ * with TCNT0 and the periodic function decodes the stamps later, so only
+ * the ack needs to be driven on time. Needs a time delta passed to the
+ * periodic function.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#include <util/atomic.h>
+
+/* Stamps are 8 bits, the whole start bit must fit in one TCNT0 period */
+#if US_TO_JIFFIES_UP(CEC_START_HIGH_LATE) > 255
+#error "TCNT0 rolls over within a start bit, increase TCNT0_ROLLOVER_PERIOD_US"
+#endif
+
+/* Must be a power of 2, two edges per bit */
+#ifndef CEC_RECEIVE_EDGES
+#define CEC_RECEIVE_EDGES	8
+#endif
+
+#ifndef CEC_RECEIVE_PCINT_vect
+#define CEC_RECEIVE_PCINT_vect	PCINT0_vect
+#endif
+#ifndef CEC_RECEIVE_PCMSK
+#define CEC_RECEIVE_PCMSK	PCMSK
+#endif
+#ifndef CEC_RECEIVE_PCIE
+#define CEC_RECEIVE_PCIE	GIMSK |= _BV(PCIE)
+#endif
+#ifndef CEC_RECEIVE_COMPB_vect
+#define CEC_RECEIVE_COMPB_vect	TIMER0_COMPB_vect
+#endif
+#ifndef CEC_RECEIVE_TIMSK
+#define CEC_RECEIVE_TIMSK	TIMSK
+#endif
+#ifndef CEC_RECEIVE_TIFR
+#define CEC_RECEIVE_TIFR	TIFR
+#endif
+
+struct cec_receive_edge {
+	unsigned char ts;
+	bool high;
+};
+
+/* Filled by the pin change interrupt, drained by cec_receive_periodic */
+static struct cec_receive_edge receive_edges[CEC_RECEIVE_EDGES];
+static volatile unsigned char receive_edge_head;
+static volatile unsigned char receive_edge_tail;
+static volatile bool receive_edge_lost;
+
+/* Falling edges seen by the interrupt, and the one to ack on */
+static volatile unsigned char receive_isr_seq;
+static volatile unsigned char receive_ack_seq;
+static volatile bool receive_ack_armed;
+
+/* Decoder state, all stamps are relative to the last falling edge */
+static unsigned char receive_fall;
+static unsigned char receive_fall_seq;
+static unsigned char receive_period;
+static unsigned int receive_frame_timer;
+static unsigned int receive_nack_done;
+static bool receive_last_state = true;
+static bool receive_sample;
+
+static void cec_receive_nack_frame(void)
+{
+	/* We lost sync and don't know where to nack, just blast the line */
+	cec_receive_drive_low();
+
+	/* Nack for a full frame */
+	receive_nack_done = US_TO_JIFFIES(10 * CEC_PERIOD);
+	receive_frame_timer = 0;
+}
+
+ISR(CEC_RECEIVE_PCINT_vect)
+{
+	unsigned char ts = TCNT0;
+	unsigned char head = receive_edge_head;
+	unsigned char next = (head + 1) & (CEC_RECEIVE_EDGES - 1);
+	bool high = cec_input_state();
+
+	if (!high && ++receive_isr_seq == receive_ack_seq && receive_ack_armed) {
+		/* Start of our ack bit, hold it for a 0 */
+		cec_receive_drive_low();
+		receive_ack_armed = false;
+		OCR0B = ts + US_TO_JIFFIES_RND(CEC_0);
+		CEC_RECEIVE_TIFR = _BV(OCF0B);
+		CEC_RECEIVE_TIMSK |= _BV(OCIE0B);
+	}
+
+	if (next == receive_edge_tail) {
+		receive_edge_lost = true;
+		return;
+	}
+
+	receive_edges[head].ts = ts;
+	receive_edges[head].high = high;
+	receive_edge_head = next;
+}
+
+ISR(CEC_RECEIVE_COMPB_vect)
+{
+	/* Done acking */
+	cec_receive_float();
+	CEC_RECEIVE_TIMSK &= ~_BV(OCIE0B);
+}
+
+static void cec_receive_sample(bool bit)
+{
+	receive_sample = false;
+	if (!cec_receive_flags)
+		/* Frame was dropped since the falling edge */
+		return;
+	cec_receive_bit(bit);
+
+	if ((cec_receive_flags & CEC_RECV_DO_ACK) &&
+	    (cec_receive_flags & CEC_RECV_BITS_EOM) && !cec_receive_byte) {
+		/*
+		 * Byte is done and the EOM bit is next, the ack bit after it.
+		 * Arm now so the interrupt can drive it even if we are a
+		 * full bit late getting back here.
+		 */
+		receive_ack_seq = receive_fall_seq + 2;
+		receive_ack_armed = true;
+	}
+}
+
+static void cec_receive_edge(unsigned char ts, bool high, unsigned char now)
+{
+	unsigned char low;
+
+	if (high == receive_last_state)
+		/* Glitch too short to see the level */
+		return;
+	receive_last_state = high;
+
+	if (high) {
+		/* Rising edge */
+		low = ts - receive_fall;
+		if (low > US_TO_JIFFIES(CEC_START_LOW_EARLY) &&
+		    low < US_TO_JIFFIES_UP(CEC_START_LOW_LATE)) {
+			receive_period = US_TO_JIFFIES_RND(CEC_START_HIGH_EARLY - 200);
+			receive_sample = false;
+			/* Start */
+			cec_receive_start();
+		} else if (receive_sample)
+			cec_receive_sample(low < US_TO_JIFFIES_RND(CEC_NOM_SAMPLE));
+	} else {
+		/* Falling edge */
+		receive_fall_seq++;
+		if (receive_ack_armed &&
+		    (signed char) (receive_fall_seq - receive_ack_seq) >= 0)
+			/* Decoded too late, the ack window is gone */
+			receive_ack_armed = false;
+
+		if (cec_receive_flags) {
+			if ((unsigned char) (ts - receive_fall) < receive_period)
+				/* Error */
+				cec_receive_error(CEC_ERR_LOW_DRIVE);
+			else
+				receive_sample = true;
+		}
+		receive_period = US_TO_JIFFIES_RND(CEC_T7_EARLY_END - 50);
+		receive_fall = ts;
+		receive_frame_timer = (unsigned char) (now - ts);
+	}
+}
+
+static void cec_receive_periodic(unsigned int delta)
+{
+	unsigned char tail = receive_edge_tail;
+	unsigned char now;
+	bool empty;
+
+	cec_add_cap(receive_frame_timer, delta);
+
+	if (receive_edge_lost) {
+		/* Ring overflowed, drop everything and resync */
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			tail = receive_edge_head;
+			receive_edge_tail = tail;
+			receive_fall_seq = receive_isr_seq;
+			receive_ack_armed = false;
+			receive_edge_lost = false;
+		}
+		receive_last_state = cec_input_state();
+		receive_sample = false;
+		cec_receive_error(CEC_ERR_HW);
+	}
+
+	for (;;) {
+		/* Any edge after now would still be in the ring */
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			now = TCNT0;
+			empty = tail == receive_edge_head;
+		}
+		if (empty)
+			break;
+
+		cec_receive_edge(receive_edges[tail].ts,
+					receive_edges[tail].high, now);
+		tail = (tail + 1) & (CEC_RECEIVE_EDGES - 1);
+		receive_edge_tail = tail;
+	}
+
+	/* Still low past the sample point, no need to wait for the edge */
+	if (receive_sample && (unsigned char) (now - receive_fall) >
+					US_TO_JIFFIES_RND(CEC_NOM_SAMPLE))
+		cec_receive_sample(false);
+
+	if (receive_nack_done && receive_frame_timer > receive_nack_done) {
+		/* Done nacking */
+		cec_receive_float();
+		receive_nack_done = 0;
+	}
+
+	if (cec_receive_flags && receive_frame_timer > (unsigned int)
+			receive_period + (unsigned short) US_TO_JIFFIES_UP(800))
+		/* We've gone 600uS without an expected transition */
+		cec_receive_error(CEC_ERR_NO_EOM);
+}
+
+static void cec_receive_halt_hw(void)
+{
+	CEC_RECEIVE_PCMSK &= ~_BV(CEC_PBIN);
+	CEC_RECEIVE_TIMSK &= ~_BV(OCIE0B);
+	receive_ack_armed = false;
+	receive_nack_done = 0;
+	cec_receive_float();
+}
+
+static void cec_receive_init(void)
+{
+	receive_edge_tail = receive_edge_head;
+	receive_fall_seq = receive_isr_seq;
+	receive_last_state = cec_input_state();
+	receive_sample = false;
+
+	CEC_RECEIVE_PCMSK |= _BV(CEC_PBIN);
+	CEC_RECEIVE_PCIE;
+}
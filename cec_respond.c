@@ -0,0 +1,205 @@
+/*
+ * Answers the queries every device has to, without involving the user
+ * app. The receive engine hands us directed two byte messages, the ones
+ * we take never reach a receive slot. Replies are queued from
+ * cec_periodic() at TRANSMIT_PRIO_REPLY, the queue isn't safe to fill
+ * from interrupt context.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+
+#include <stdbool.h>
+
+#include <avr/pgmspace.h>
+
+#include "cec_msg.h"
+#include "cec_spec.h"
+
+#ifdef CEC_RESPONDER
+
+#ifndef CEC_TRANSMIT_QUEUE
+#error "CEC_RESPONDER needs CEC_TRANSMIT_QUEUE"
+#endif
+
+#if CEC_MONITOR
+#error "CEC_RESPONDER can't be used in monitor mode"
+#endif
+
+#ifndef CEC_RESPONDER_DEV_TYPE
+#ifdef CEC_DEV_TYPE
+#define CEC_RESPONDER_DEV_TYPE	CEC_DEV_TYPE
+#elif defined(CEC_DEV_TYPES)
+/* Report the type that claimed the address that was asked */
+#define CEC_RESPONDER_DEV_TYPE	0
+#define cec_respond_dev_type(hdr)	cec_addr_dev_type((hdr) & 0xf)
+#else
+#error "CEC_RESPONDER needs CEC_RESPONDER_DEV_TYPE or CEC_DEV_TYPE"
+#endif
+#endif
+
+#ifndef cec_respond_dev_type
+#define cec_respond_dev_type(hdr)	pgm_read_byte(cec_respond_info)
+#endif
+
+#ifndef CEC_PHYSICAL_ADDRESS
+#define CEC_PHYSICAL_ADDRESS	0xffff
+#endif
+
+#ifndef CEC_RESPONDER_VERSION
+#define CEC_RESPONDER_VERSION	CEC_MSG_CEC_VERSION_1_4
+#endif
+
+/* Fixed parts of our replies */
+PROGMEM static const unsigned char cec_respond_info[] = {
+	CEC_RESPONDER_DEV_TYPE,
+	CEC_RESPONDER_VERSION,
+#ifdef CEC_VENDOR_ID
+	(CEC_VENDOR_ID >> 16) & 0xff,
+	(CEC_VENDOR_ID >> 8) & 0xff,
+	CEC_VENDOR_ID & 0xff,
+#endif
+};
+
+#ifdef CEC_OSD_NAME
+/* At most 14 characters, the terminator isn't sent */
+PROGMEM static const char cec_respond_osd_name[] = CEC_OSD_NAME;
+#define CEC_OSD_NAME_LEN	(sizeof(cec_respond_osd_name) - 1 > 14 ? 14 : \
+					sizeof(cec_respond_osd_name) - 1)
+#endif
+
+/* Reported by the replies, the user app keeps these up to date */
+unsigned short cec_physical_address = CEC_PHYSICAL_ADDRESS;
+unsigned char cec_power_status = CEC_MSG_POWER_STATUS_ON;
+
+#ifndef CEC_RESPONDER_PENDING
+#define CEC_RESPONDER_PENDING	4
+#endif
+
+/*
+ * Queries waiting for a reply, header and opcode as received. Filled by
+ * the receive engine and drained by cec_periodic(), one entry is always
+ * left empty.
+ */
+static unsigned char cec_respond_queue[CEC_RESPONDER_PENDING + 1][2];
+static volatile unsigned char cec_respond_head;
+static volatile unsigned char cec_respond_tail;
+
+/* Called by the receive engine, true if we take the message */
+static bool cec_respond_rx(unsigned char hdr, unsigned char opcode)
+{
+	unsigned char head = cec_respond_head;
+	unsigned char next = head == CEC_RESPONDER_PENDING ? 0 : head + 1;
+
+	switch (opcode) {
+	case CEC_MSG_GET_CEC_VERSION:
+	case CEC_MSG_GIVE_DEVICE_POWER_STATUS:
+#ifdef CEC_OSD_NAME
+	case CEC_MSG_GIVE_OSD_NAME:
+#endif
+		if ((hdr >> 4) == CEC_ADDR_UNREGISTERED)
+			/* A directed reply would go out as a broadcast */
+			return false;
+		break;
+	case CEC_MSG_GIVE_PHYSICAL_ADDRESS:
+#ifdef CEC_VENDOR_ID
+	case CEC_MSG_GIVE_DEVICE_VENDOR_ID:
+#endif
+		/* Broadcast replies, fine for unregistered too */
+		break;
+	default:
+		return false;
+	}
+
+	if (next == cec_respond_tail)
+		/* Backed up, let the user app have it */
+		return false;
+
+	cec_respond_queue[head][0] = hdr;
+	cec_respond_queue[head][1] = opcode;
+	cec_respond_head = next;
+	return true;
+}
+
+/* Queue replies for pending queries, as long as there is room */
+static void cec_respond_periodic(void)
+{
+	struct cec_transmit_entry *e;
+	unsigned char tail;
+	unsigned char hdr;
+
+	while ((tail = cec_respond_tail) != cec_respond_head) {
+		e = cec_transmit_alloc(TRANSMIT_PRIO_REPLY);
+		if (!e)
+			return;
+
+		/* Back from the address that was asked to the one asking */
+		hdr = cec_respond_queue[tail][0];
+		e->buf[0] = cec_swap(hdr);
+
+		switch (cec_respond_queue[tail][1]) {
+		case CEC_MSG_GIVE_PHYSICAL_ADDRESS:
+			e->buf[0] = (hdr << 4) | CEC_ADDR_BROADCAST;
+			e->buf[1] = CEC_MSG_REPORT_PHYSICAL_ADDRESS;
+			e->buf[2] = cec_physical_address >> 8;
+			e->buf[3] = cec_physical_address;
+			e->buf[4] = cec_respond_dev_type(hdr);
+			e->end = 4;
+			break;
+		case CEC_MSG_GET_CEC_VERSION:
+			e->buf[1] = CEC_MSG_CEC_VERSION;
+			e->buf[2] = pgm_read_byte(cec_respond_info + 1);
+			e->end = 2;
+			break;
+		case CEC_MSG_GIVE_DEVICE_POWER_STATUS:
+			e->buf[1] = CEC_MSG_REPORT_POWER_STATUS;
+			e->buf[2] = cec_power_status;
+			e->end = 2;
+			break;
+#ifdef CEC_VENDOR_ID
+		case CEC_MSG_GIVE_DEVICE_VENDOR_ID:
+			e->buf[0] = (hdr << 4) | CEC_ADDR_BROADCAST;
+			e->buf[1] = CEC_MSG_DEVICE_VENDOR_ID;
+			memcpy_P(e->buf + 2, cec_respond_info + 2, 3);
+			e->end = 4;
+			break;
+#endif
+#ifdef CEC_OSD_NAME
+		case CEC_MSG_GIVE_OSD_NAME:
+			e->buf[1] = CEC_MSG_SET_OSD_NAME;
+			memcpy_P(e->buf + 2, cec_respond_osd_name,
+							CEC_OSD_NAME_LEN);
+			e->end = 1 + CEC_OSD_NAME_LEN;
+			break;
+#endif
+		}
+
+		cec_transmit_commit(TRANSMIT_PRIO_REPLY);
+		cec_respond_tail = tail == CEC_RESPONDER_PENDING ? 0 : tail + 1;
+	}
+}
+
+/* Forget any queries, the receive side must not be running */
+static void cec_respond_init(void)
+{
+	cec_respond_head = 0;
+	cec_respond_tail = 0;
+}
+#else
+#define cec_respond_periodic()	do {} while (0)
+#define cec_respond_init()	do {} while (0)
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Jiffies and a timer wheel for timeouts in the order of milliseconds to
+ * seconds. Time comes from the deltas passed to cec_periodic(), which are
+ * TCNT0 counts, so everything here runs in cec_periodic() context.
+ *
+ * Each timer sits in the wheel bucket for the tick it expires on. Starting
+ * and stopping a timer is a linked list insert or remove. Each tick walks
+ * one bucket once, which also holds timers a trip or more round the wheel
+ * away, and moves the expired ones to a list of their own before calling
+ * any handlers.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+
+#if defined(CEC_JIFFIES) || defined(CEC_TIMERS)
+
+#ifndef TIME_PUBLIC
+#define TIME_PUBLIC CEC_PUBLIC
+#endif
+#include "time.h"
+
+/* Sum of every delta passed to cec_periodic(), wraps */
+static __uint24 cec_jiffies;
+
+TIME_PUBLIC __uint24 jiffies(void)
+{
+	return cec_jiffies;
+}
+
+#ifdef CEC_TIMERS
+
+#ifndef CEC_TIMER_TICK_MS
+#define CEC_TIMER_TICK_MS	8
+#endif
+
+/* Buckets, a power of 2, timers can be longer than one trip round */
+#ifndef CEC_TIMER_WHEEL
+#define CEC_TIMER_WHEEL		16
+#endif
+
+#define CEC_TIMER_TICK		MS_TO_JIFFIES_RND(CEC_TIMER_TICK_MS)
+
+#if CEC_TIMER_TICK < 1 || CEC_TIMER_TICK > 0xffff
+#error "CEC_TIMER_TICK_MS does not fit TCNT0_ROLLOVER_PERIOD_US"
+#endif
+
+#if CEC_TIMER_WHEEL & (CEC_TIMER_WHEEL - 1) || CEC_TIMER_WHEEL > 64
+#error "CEC_TIMER_WHEEL must be a power of 2, 64 at most"
+#endif
+
+#if CEC_TIMERS > 127
+#error "At most 127 timers"
+#endif
+
+/* Timer ticks to wait for at least ms */
+#define MS_TO_CEC_TIMER(ms)	(DIV_ROUND_UP(ms, CEC_TIMER_TICK_MS) + 1)
+
+/* Links are timer id + 1, 0 ends a list */
+#define CEC_TIMER_HEAD		_BV(7)	/* prev is a bucket instead */
+
+#ifndef _CEC_TIMER_STRUCT_
+#define _CEC_TIMER_STRUCT_
+struct cec_timer {
+	unsigned char next;
+	unsigned char prev;		/* 0 if not running */
+	unsigned short expires;		/* Tick */
+};
+#endif
+
+static struct cec_timer cec_timers[CEC_TIMERS];
+/* Extra bucket for timers that ran out this tick, handlers not called yet */
+#define CEC_TIMER_EXPIRED_LIST	CEC_TIMER_WHEEL
+
+static unsigned char cec_timer_wheel[CEC_TIMER_WHEEL + 1];
+static unsigned short cec_timer_now;
+static __uint24 cec_timer_frac;
+
+/* Called with the timer id when it runs out, may restart it */
+#ifndef CEC_TIMER_EXPIRED
+#ifndef CEC_EVENTS
+#error "CEC_TIMERS needs CEC_EVENTS or a CEC_TIMER_EXPIRED handler"
+#endif
+#define CEC_TIMER_EXPIRED(id)	cec_event_post(CEC_EVENT_TIMER, id)
+#endif
+
+#define cec_timer_pending(id)	(cec_timers[id].prev != 0)
+
+CEC_PUBLIC void cec_timer_stop(unsigned char id)
+{
+	struct cec_timer *t = &cec_timers[id];
+
+	if (!t->prev)
+		return;
+
+	if (t->next)
+		cec_timers[t->next - 1].prev = t->prev;
+	if (t->prev & CEC_TIMER_HEAD)
+		cec_timer_wheel[t->prev & ~CEC_TIMER_HEAD] = t->next;
+	else
+		cec_timers[t->prev - 1].next = t->next;
+	t->prev = 0;
+}
+
+/* Put a stopped timer at the head of bucket */
+static void cec_timer_link(unsigned char id, unsigned char bucket)
+{
+	struct cec_timer *t = &cec_timers[id];
+
+	t->next = cec_timer_wheel[bucket];
+	t->prev = CEC_TIMER_HEAD | bucket;
+	if (t->next)
+		cec_timers[t->next - 1].prev = id + 1;
+	cec_timer_wheel[bucket] = id + 1;
+}
+
+/* Expire after ticks more ticks go by, 0 counts as 1 */
+CEC_PUBLIC void cec_timer_start(unsigned char id, unsigned short ticks)
+{
+	struct cec_timer *t = &cec_timers[id];
+
+	cec_timer_stop(id);
+
+	if (!ticks)
+		ticks = 1;
+	t->expires = cec_timer_now + ticks;
+	cec_timer_link(id, t->expires & (CEC_TIMER_WHEEL - 1));
+}
+
+static void cec_timer_tick(void)
+{
+	unsigned short now = ++cec_timer_now;
+	unsigned char n = cec_timer_wheel[now & (CEC_TIMER_WHEEL - 1)];
+	unsigned char id;
+
+	/* One pass, no handler runs until the bucket is done */
+	while (n) {
+		id = n - 1;
+		n = cec_timers[id].next;
+		if (cec_timers[id].expires == now) {
+			cec_timer_stop(id);
+			cec_timer_link(id, CEC_TIMER_EXPIRED_LIST);
+		}
+	}
+
+	/* A handler may start or stop any timer, even one still listed */
+	while ((n = cec_timer_wheel[CEC_TIMER_EXPIRED_LIST])) {
+		id = n - 1;
+		cec_timer_stop(id);
+		CEC_TIMER_EXPIRED(id);
+	}
+}
+#endif
+
+static void cec_timer_periodic(unsigned int delta)
+{
+	cec_jiffies += delta;
+
+#ifdef CEC_TIMERS
+	cec_timer_frac += delta;
+	while (cec_timer_frac >= CEC_TIMER_TICK) {
+		cec_timer_frac -= CEC_TIMER_TICK;
+		cec_timer_tick();
+	}
+#endif
+}
+
+#else
+#define cec_timer_periodic(delta)	do {} while (0)
+#endif
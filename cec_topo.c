@@ -0,0 +1,233 @@
+/*
+ * A table of the other devices on the bus, filled in from the traffic the
+ * receive engine sees anyway. Lets the user app skip most of the
+ * <Give Physical Address>, <Give Device Vendor ID> and power status
+ * queries it would otherwise send to find out who is there.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+
+#include <string.h>
+#include <util/atomic.h>
+
+#include "cec.h"
+#include "cec_msg.h"
+#include "cec_spec.h"
+
+#ifdef CEC_TOPOLOGY
+
+#ifndef TIME_PUBLIC
+#define TIME_PUBLIC CEC_PUBLIC
+#endif
+#include "time.h"
+
+/* 0xff bytes for anything not reported yet */
+#ifndef _CEC_TOPO_DEV_
+#define _CEC_TOPO_DEV_
+struct cec_topo_dev {
+	unsigned short phys;		/* Physical address */
+	unsigned char type;		/* CEC_DEV_* */
+	unsigned char power;		/* CEC_MSG_POWER_STATUS_* */
+	unsigned char vendor[3];	/* IEEE OUI, MSB first */
+	unsigned short seen;		/* cec_topo_now when last heard */
+};
+#endif
+
+/* One entry per logical address, unregistered isn't tracked */
+static struct cec_topo_dev cec_topo[CEC_ADDR_BROADCAST];
+
+/* Addresses heard from or acking, and those heard since the last periodic */
+static volatile unsigned short cec_topo_present;
+static volatile unsigned short cec_topo_fresh;
+
+/*
+ * Header, opcode and first operands of the frame the receive engine is
+ * on. Kept here so reports are seen even if the frame isn't stored.
+ */
+static unsigned char cec_topo_buf[5];
+
+/* Seconds, counted from the deltas passed to cec_periodic() */
+static unsigned short cec_topo_now;
+static __uint24 cec_topo_frac;
+
+static void cec_topo_clear(unsigned char addr)
+{
+	memset(&cec_topo[addr], 0xff, sizeof(cec_topo[addr]));
+}
+
+static void cec_topo_seen(unsigned char addr)
+{
+	cec_topo_present |= 1 << addr;
+	cec_topo_fresh |= 1 << addr;
+}
+
+/* Gone, or someone new will take the address, forget everything */
+static void cec_topo_gone(unsigned char addr)
+{
+	cec_topo_present &= ~(1 << addr);
+	cec_topo_fresh &= ~(1 << addr);
+	cec_topo_clear(addr);
+}
+
+/* Called by the receive engine with byte pos of every frame */
+static void cec_topo_byte(unsigned char pos, unsigned char byte)
+{
+	if (pos < sizeof(cec_topo_buf))
+		cec_topo_buf[pos] = byte;
+}
+
+/* Called by the receive engine when a frame of len bytes is done */
+static void cec_topo_rx(unsigned char len, bool nacked)
+{
+	const unsigned char *msg = cec_topo_buf;
+	unsigned char src = msg[0] >> 4;
+	unsigned char dst = msg[0] & 0xf;
+	struct cec_topo_dev *dev;
+	unsigned char i;
+
+	if (dst != CEC_ADDR_BROADCAST && !cec_addr_match(dst)) {
+		if (len == 1 && nacked)
+			/* Nobody took the header */
+			cec_topo_gone(dst);
+		else
+			cec_topo_seen(dst);
+	}
+
+	/* A poll is someone looking for an address, not there yet */
+	if (src == CEC_ADDR_UNREGISTERED || src == dst)
+		return;
+
+	cec_topo_seen(src);
+
+	if (len < 2)
+		return;
+
+	dev = &cec_topo[src];
+
+	switch (msg[1]) {
+	case CEC_MSG_REPORT_PHYSICAL_ADDRESS:
+		if (len >= 5) {
+			dev->phys = (msg[2] << 8) | msg[3];
+			dev->type = msg[4];
+		}
+		break;
+	case CEC_MSG_DEVICE_VENDOR_ID:
+		if (len >= 5)
+			memcpy(dev->vendor, msg + 2, 3);
+		break;
+	case CEC_MSG_REPORT_POWER_STATUS:
+		if (len >= 3)
+			dev->power = msg[2];
+		break;
+	case CEC_MSG_STANDBY:
+		/* They may or may not go, we don't know any more */
+		if (dst != CEC_ADDR_BROADCAST)
+			cec_topo[dst].power = 0xff;
+		else
+			for (i = 0; i < CEC_ADDR_BROADCAST; i++)
+				cec_topo[i].power = 0xff;
+		break;
+	}
+}
+
+/* Copy out what we know about addr, false if it isn't there */
+CEC_PUBLIC bool cec_topo_get(unsigned char addr, struct cec_topo_dev *dev)
+{
+	bool present;
+
+	if (addr >= CEC_ADDR_BROADCAST)
+		return false;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		present = cec_topo_present & (1 << addr);
+		*dev = cec_topo[addr];
+	}
+	return present;
+}
+
+/* Addresses we know to be there, bit n for logical address n */
+CEC_PUBLIC unsigned short cec_topo_devices(void)
+{
+	unsigned short present;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		present = cec_topo_present;
+	}
+	return present;
+}
+
+/* Seconds since addr was last heard from or acked, wraps after 18 hours */
+CEC_PUBLIC unsigned short cec_topo_age(unsigned char addr)
+{
+	unsigned short seen;
+
+	if (addr >= CEC_ADDR_BROADCAST)
+		/* Not tracked, as old as it gets */
+		return 0xffff;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		seen = cec_topo[addr].seen;
+	}
+	return cec_topo_now - seen;
+}
+
+CEC_PUBLIC void cec_topo_forget(unsigned char addr)
+{
+	if (addr >= CEC_ADDR_BROADCAST)
+		return;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		cec_topo_gone(addr);
+	}
+}
+
+static void cec_topo_periodic(unsigned int delta)
+{
+	unsigned short fresh;
+	unsigned char i;
+
+	/* The receive engine only marks them, time stamps are done here */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		fresh = cec_topo_fresh;
+		cec_topo_fresh = 0;
+	}
+	for (i = 0; fresh; i++, fresh >>= 1)
+		if (fresh & 1)
+			cec_topo[i].seen = cec_topo_now;
+
+	cec_topo_frac += delta;
+	while (cec_topo_frac >= S_TO_JIFFIES(1)) {
+		cec_topo_frac -= S_TO_JIFFIES(1);
+		cec_topo_now++;
+	}
+}
+
+/* Nothing known, the receive side must not be running */
+static void cec_topo_init(void)
+{
+	unsigned char i;
+
+	cec_topo_present = 0;
+	cec_topo_fresh = 0;
+	for (i = 0; i < CEC_ADDR_BROADCAST; i++)
+		cec_topo_clear(i);
+}
+#else
+#define cec_topo_periodic(delta)	do {} while (0)
+#define cec_topo_init()			do {} while (0)
+#endif
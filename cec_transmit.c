@@ -20,9 +20,11 @@
 #include <avr/io.h>
 #include <stdbool.h>
 
+#include <util/atomic.h>
+
 #include "cec_spec.h"
 
-#ifndef CEC_USI
+#ifndef CEC_IDLE_FRAMES
 #include "time.h"
 #endif
 #include "bitops.h"
@@ -56,11 +58,60 @@ static unsigned char transmit_state;
 
 static unsigned char transmit_retries;
 
+#ifdef CEC_EVENTS
+/* Error that ended the last attempt, reported if we give up */
+static unsigned char transmit_last_err;
+#endif
+
+#ifdef CEC_TRANSMIT_QUEUE
+/*
+ * Queue of pending messages, one ring per priority. Each entry carries
+ * its own state with the same meaning as transmit_state. An entry at the
+ * head of a ring is free once its state drops below TRANSMIT_PEND, the
+ * entry at the tail is the next to be sent.
+ */
+#define TRANSMIT_PRIO_REPLY	0
+#define TRANSMIT_PRIO_NORMAL	1
+#define TRANSMIT_PRIOS		2
+
+/* Entry flags */
+#define TRANSMIT_ENTRY_BURST	_BV(0)	/* Next entry follows immediately */
+#define TRANSMIT_ENTRY_POLL	_BV(1)	/* Address poll, no TX events */
+
+#ifndef _CEC_TRANSMIT_ENTRY_
+#define _CEC_TRANSMIT_ENTRY_
+struct cec_transmit_entry {
+	unsigned char state;
+	unsigned char flags;
+	unsigned char end;
+	unsigned char buf[CEC_BUFFER_SIZE];
+};
+#endif
+
+struct cec_transmit_entry transmit_queue[TRANSMIT_PRIOS][CEC_TRANSMIT_QUEUE];
+static unsigned char transmit_queue_head[TRANSMIT_PRIOS];
+static unsigned char transmit_queue_tail[TRANSMIT_PRIOS];
+
+/* Entry currently loaded into transmit_buf */
+static struct cec_transmit_entry *transmit_entry;
+static unsigned char transmit_entry_prio;
+
+/* Priority + 1 of the ring a burst is being sent from, 0 if none */
+static unsigned char transmit_burst;
+
+/* Idle bit periods spent between members of a burst */
+unsigned int transmit_burst_idle;
+
+/* Until we have an address, only our own polls and replies go out */
+#define cec_transmit_held(prio)	((prio) != TRANSMIT_PRIO_REPLY && \
+					!cec_addr_ready())
+#endif
+
 #if defined(CEC_USI) || defined(CEC_TRANSMIT_PWM)
 #define CHECK_BIT_DELAY 1
 #endif
 
-#ifdef CEC_USI
+#ifdef CEC_IDLE_FRAMES
 #ifdef CEC_NEEDED_IDLE_FRAMES_REG
 register unsigned char needed_idle_frames CEC_NEEDED_IDLE_FRAMES_REG;
 #else
@@ -72,12 +123,165 @@ unsigned int needed_idle_time;
 
 static void cec_transmit_abort(void);
 
+#ifdef CEC_TRANSMIT_QUEUE
+/* Returns a free entry to fill in, or NULL if the ring is full */
+CEC_PUBLIC struct cec_transmit_entry *cec_transmit_alloc(unsigned char prio)
+{
+	struct cec_transmit_entry *e;
+
+	e = &transmit_queue[prio][transmit_queue_head[prio]];
+	if (e->state >= TRANSMIT_PEND)
+		return NULL;
+
+	e->flags = 0;
+	return e;
+}
+
+/* Queue up the entry last returned by cec_transmit_alloc */
+CEC_PUBLIC void cec_transmit_commit(unsigned char prio)
+{
+	unsigned char head = transmit_queue_head[prio];
+
+	transmit_queue[prio][head].state = TRANSMIT_PEND;
+	transmit_queue_head[prio] = head + 1 == CEC_TRANSMIT_QUEUE ? 0 : head + 1;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (transmit_state < TRANSMIT_PEND && !cec_transmit_held(prio))
+			transmit_state = TRANSMIT_PEND;
+	}
+}
+
+static struct cec_transmit_entry *cec_transmit_next(void)
+{
+	unsigned char prio;
+	struct cec_transmit_entry *e;
+
+	if (transmit_burst) {
+		/*
+		 * Stay on the same ring so nothing else gets between
+		 * the members of a burst.
+		 */
+		prio = transmit_burst - 1;
+		e = &transmit_queue[prio][transmit_queue_tail[prio]];
+		if (e->state == TRANSMIT_PEND) {
+			transmit_entry_prio = prio;
+			return e;
+		}
+
+		/* Next member wasn't queued in time, burst is over */
+		transmit_burst = 0;
+	}
+
+	for (prio = 0; prio < TRANSMIT_PRIOS; prio++) {
+		e = &transmit_queue[prio][transmit_queue_tail[prio]];
+		if (e->state == TRANSMIT_PEND && !cec_transmit_held(prio)) {
+			transmit_entry_prio = prio;
+			return e;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * We just got an address. Entries queued before then were built with the
+ * old one (unregistered at first) as initiator, give them the new one and
+ * send them.
+ */
+static void cec_transmit_release_held(unsigned char old, unsigned char addr)
+{
+	unsigned char i;
+
+	for (i = 0; i < CEC_TRANSMIT_QUEUE; i++) {
+		struct cec_transmit_entry *e = &transmit_queue[TRANSMIT_PRIO_NORMAL][i];
+
+		if (e->state == TRANSMIT_PEND &&
+		    (e->buf[0] >> 4) == old)
+			e->buf[0] = cec_swap(addr) | (e->buf[0] & 0xf);
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (transmit_state < TRANSMIT_PEND && cec_transmit_next())
+			transmit_state = TRANSMIT_PEND;
+	}
+}
+
+/* Pick the highest priority pending entry and load it into transmit_buf */
+static void cec_transmit_load(void)
+{
+	struct cec_transmit_entry *e = cec_transmit_next();
+
+	if (e) {
+		transmit_buf_end = e->end;
+		memcpy(transmit_buf, e->buf, e->end + 1);
+	}
+	transmit_entry = e;
+}
+#endif
+
+/* The current message is finished, IDLE on success or FAILED */
+static void cec_transmit_done(unsigned char state)
+{
+#ifdef CEC_TRANSMIT_QUEUE
+	struct cec_transmit_entry *e = transmit_entry;
+	unsigned char prio = transmit_entry_prio;
+#ifdef CEC_EVENTS
+	bool poll = e && (e->flags & TRANSMIT_ENTRY_POLL);
+#endif
+
+	if (e) {
+		unsigned char tail = transmit_queue_tail[prio];
+
+		e->state = state;
+		transmit_queue_tail[prio] = tail + 1 == CEC_TRANSMIT_QUEUE ? 0 : tail + 1;
+		transmit_entry = NULL;
+		transmit_burst = (e->flags & TRANSMIT_ENTRY_BURST) ? prio + 1 : 0;
+	}
+#elif defined(CEC_EVENTS)
+	unsigned char prio = 0;
+	/* Without a queue the only polls are the ones before we're ready */
+	bool poll = !cec_addr_ready();
+#endif
+
+#ifdef CEC_EVENTS
+	/* Address polls are expected to fail, keep them out of the queue */
+	if (!poll) {
+		if (state == TRANSMIT_FAILED)
+			cec_event_post(CEC_EVENT_TX_FAILED,
+					(prio << 4) | transmit_last_err);
+		else
+			cec_event_post(CEC_EVENT_TX_DONE, prio);
+	}
+#endif
+
+#ifdef CEC_TRANSMIT_QUEUE
+	/* Keep going if there is more work queued */
+	if (cec_transmit_next()) {
+		/*
+		 * We're the present initiator whether or not the last
+		 * message made it, don't let a retransmit wait carry over.
+		 * Bursts only change which entry goes next.
+		 */
+#ifdef CEC_IDLE_FRAMES
+		needed_idle_frames = CEC_PRESENT_PERIOD_WAIT;
+#else
+		needed_idle_time = US_TO_JIFFIES_UP(CEC_PRESENT_PERIOD_WAIT
+								* CEC_PERIOD);
+#endif
+		state = TRANSMIT_PEND;
+	}
+#endif
+	transmit_state = state;
+}
+
 /* An error was detected */
 static void cec_transmit_on_error(unsigned char err)
 {
 	if (transmit_state > TRANSMIT_AGAIN) {
 #ifdef CEC_ERR_STATS
 		transmit_state_buf[err]++;
+#endif
+#ifdef CEC_EVENTS
+		transmit_last_err = err;
 #endif
 		/* Inform the hardware */
 		cec_transmit_abort();
@@ -89,11 +293,11 @@ static void cec_transmit_finish_abort(void)
 {
 	if (++transmit_retries == CEC_XMIT_MAX_RETRANSMIT)
 		/* No more retransmits left */
-		transmit_state = TRANSMIT_FAILED;
+		cec_transmit_done(TRANSMIT_FAILED);
 
 	else {
 		/* Perform a retransmit */
-#ifdef CEC_USI
+#ifdef CEC_IDLE_FRAMES
 		needed_idle_frames = CEC_PREV_PERIOD_WAIT;
 #else
 		needed_idle_time = US_TO_JIFFIES_UP(CEC_PREV_PERIOD_WAIT
@@ -105,6 +309,21 @@ static void cec_transmit_finish_abort(void)
 
 static void cec_transmit_halt(void)
 {
+#ifdef CEC_TRANSMIT_QUEUE
+	unsigned char prio;
+	unsigned char i;
+
+	/* Fail anything still queued */
+	for (prio = 0; prio < TRANSMIT_PRIOS; prio++) {
+		for (i = 0; i < CEC_TRANSMIT_QUEUE; i++)
+			if (transmit_queue[prio][i].state >= TRANSMIT_PEND)
+				transmit_queue[prio][i].state = TRANSMIT_FAILED;
+		transmit_queue_head[prio] = 0;
+		transmit_queue_tail[prio] = 0;
+	}
+	transmit_entry = NULL;
+	transmit_burst = 0;
+#endif
 	transmit_state = TRANSMIT_IDLE;
 	cec_transmit_halt_hw();
 }
@@ -112,6 +331,11 @@ static void cec_transmit_halt(void)
 /* Make sure the our own receive side is in sync with what we are sending */
 static void cec_check_tx_bit(unsigned char bit)
 {
+	/*
+	 * In interrupt mode the receive side may run well behind, the PWM
+	 * driver checks each bit at its sample point instead.
+	 */
+#ifndef CEC_TRANSMIT_PWM_ISR
 	unsigned char delayed = transmit_last_bit;
 #ifdef CHECK_BIT_DELAY
 	delayed >>= CHECK_BIT_DELAY;
@@ -119,27 +343,42 @@ static void cec_check_tx_bit(unsigned char bit)
 #endif
 	if (bit != delayed)
 		cec_transmit_on_error(CEC_ERR_ARB_LOST);
-
+#endif
 }
 
 static void cec_transmit_receive_ack(bool ack)
 {
 	if (ack) {
 		if (transmit_state == TRANSMIT_WAIT_FOR_ACK)
-			transmit_state = TRANSMIT_IDLE;
+			cec_transmit_done(TRANSMIT_IDLE);
 	} else
 		cec_transmit_on_error(CEC_ERR_NACK);
 }
 
-/* Hardware wants us to start the next message */
-static void cec_transmit_start(void)
+/* Get a newly pending message ready to go */
+static void cec_transmit_prepare(void)
 {
-	if (transmit_state == TRANSMIT_PEND) {
-		transmit_retries = 0;
+	transmit_retries = 0;
 #ifdef CEC_ERR_STATS
-		memset(transmit_state_buf+1, 0, sizeof(transmit_state_buf)-1);
+	memset(transmit_state_buf+1, 0, sizeof(transmit_state_buf)-1);
+#endif
+#ifdef CEC_TRANSMIT_QUEUE
+	cec_transmit_load();
+#endif
+}
+
+/*
+ * Hardware wants us to start the next message, idle is the number of
+ * bit periods the line has been free.
+ */
+static void cec_transmit_start(unsigned char idle)
+{
+	if (transmit_state == TRANSMIT_PEND)
+		cec_transmit_prepare();
+#ifdef CEC_TRANSMIT_QUEUE
+	if (transmit_burst && !transmit_retries)
+		transmit_burst_idle += idle;
 #endif
-	}
 	transmit_buf_bit = _BV(7);
 	transmit_buf_pos = 0;
 	transmit_state = TRANSMIT_BIT_EOM;
@@ -184,7 +423,7 @@ static bool cec_transmit_get_bit(void)
 			}
 
 			/* Consider us the present initiator */
-#ifdef CEC_USI
+#ifdef CEC_IDLE_FRAMES
 			needed_idle_frames = CEC_PRESENT_PERIOD_WAIT;
 #else
 			needed_idle_time = US_TO_JIFFIES_UP(CEC_PRESENT_PERIOD_WAIT
@@ -207,7 +446,7 @@ static bool cec_transmit_get_bit(void)
 
 static void cec_transmit_init(void)
 {
-#ifdef CEC_USI
+#ifdef CEC_IDLE_FRAMES
 	needed_idle_frames = CEC_NEW_PERIOD_WAIT;
 #else
 	needed_idle_time = US_TO_JIFFIES_UP(CEC_NEW_PERIOD_WAIT * CEC_PERIOD);
@@ -47,6 +47,20 @@
 #define CEC_START_PERIOD	(US_TO_CEC_JIFFIES(CEC_START_HIGH) - 1)
 #define CEC_START_TICKS		(US_TO_CEC_JIFFIES(CEC_START_LOW) - 1)
 
+#ifdef CEC_TRANSMIT_PWM_ISR
+/* Idle line sampling period, shorter than the shortest low period */
+#define CEC_IDLE_US		300
+#define CEC_IDLE_PERIOD		(US_TO_CEC_JIFFIES(CEC_IDLE_US) - 1)
+#define CEC_SAMPLE_TICKS	US_TO_CEC_JIFFIES(CEC_NOM_SAMPLE)
+
+#ifndef CEC_PWM_OVF_vect
+#define CEC_PWM_OVF_vect	TIMER1_OVF_vect
+#endif
+#ifndef CEC_PWM_COMPA_vect
+#define CEC_PWM_COMPA_vect	TIMER1_COMPA_vect
+#endif
+#endif
+
 enum {
 	XMIT_IDLE,
 	XMIT_START,
@@ -58,10 +72,34 @@ enum {
 
 static unsigned int transmit_high_timer;
 static unsigned char xmit_state;
+#ifdef CEC_TRANSMIT_PWM_ISR
+/* Check for arbitration loss in the current and next bit */
+static bool xmit_check;
+static bool xmit_check_next;
+#endif
+
+#ifdef CEC_TRANSMIT_PWM_ISR
+/* Keep the clock running for idle sampling, but let go of the pin */
+static void xmit_idle(void)
+{
+	GTCCR = _BV(PWM1B);
+	TCNT1 = 0;
+	OCR1C = CEC_IDLE_PERIOD;
+	OCR1B = 0;
+	xmit_check = false;
+	xmit_check_next = false;
+	transmit_high_timer = 0;
+	xmit_state = XMIT_IDLE;
+}
+#endif
 
 static void cec_transmit_abort(void) __attribute__((unused));
 static void cec_transmit_abort(void)
 {
+#ifdef CEC_TRANSMIT_PWM_ISR
+	xmit_idle();
+	cec_transmit_finish_abort();
+#else
 	/* Stop the clock */
 	TCCR1 = 0;
 
@@ -71,25 +109,28 @@ static void cec_transmit_abort(void)
 	cec_transmit_finish_abort();
 
 	xmit_state = XMIT_IDLE;
+#endif
 }
 
-static void xmit_pwm_periodic(void)
+/* A PWM cycle just started, load up the one after it */
+static void xmit_pwm_next(void)
 {
 	bool bit;
 
-	if (!(TIFR & _BV(TOV1)))
-		/* Not ready to load next frame yet */
-		return;
-
-	TIFR |= _BV(TOV1);
+#ifdef CEC_TRANSMIT_PWM_ISR
+	xmit_check = xmit_check_next;
+	xmit_check_next = false;
+#endif
 
 	switch (xmit_state) {
 	case XMIT_RUNNING:
+#ifndef CEC_TRANSMIT_PWM_ISR
 		if (!cec_receive_flags) {
 			/* Receive not tracking us... */
 			cec_transmit_on_error(CEC_ERR_ARB_LOST);
 			break;
 		}
+#endif
 
 		OCR1C = CEC_DATA_PERIOD;
 
@@ -98,8 +139,13 @@ static void xmit_pwm_periodic(void)
 		OCR1B = bit ? CEC_1_TICKS : CEC_0_TICKS;
 		if (transmit_state == TRANSMIT_WAIT_FOR_ACK)
 			xmit_state = XMIT_END1;
-		else
+		else {
+#ifdef CEC_TRANSMIT_PWM_ISR
+			/* Someone else may hold the line low for a 0 */
+			xmit_check_next = bit;
+#endif
 			xmit_state = XMIT_RUNNING;
+		}
 		break;
 
 	case XMIT_END1:
@@ -109,16 +155,35 @@ static void xmit_pwm_periodic(void)
 		break;
 
 	case XMIT_END2:
+#ifdef CEC_TRANSMIT_PWM_ISR
+		xmit_idle();
+#else
 		/* Stop the clock */
 		TCCR1 = 0;
 		xmit_state = XMIT_IDLE;
+#endif
 		break;
 	}
 }
 
+#ifndef CEC_TRANSMIT_PWM_ISR
+static void xmit_pwm_periodic(void)
+{
+	if (!(TIFR & _BV(TOV1)))
+		/* Not ready to load next frame yet */
+		return;
+
+	TIFR |= _BV(TOV1);
+
+	xmit_pwm_next();
+}
+#endif
+
 static void xmit_start(void)
 {
-	/* Have the interrupt fire after 1 timer clock cycle */
+	unsigned int idle;
+
+	/* Have the overflow happen after 1 timer clock cycle */
 	TCNT1 = CEC_START_PERIOD - 1;
 	OCR1C = CEC_START_PERIOD;
 
@@ -133,12 +198,66 @@ static void xmit_start(void)
 
 	/* Update state */
 	xmit_state++;
-	cec_transmit_start();
+	/* The idle count is only a byte, long quiet spells stick at 255 */
+	idle = transmit_high_timer / US_TO_JIFFIES(CEC_PERIOD);
+	cec_transmit_start(idle > 0xff ? 0xff : idle);
 
+#ifndef CEC_TRANSMIT_PWM_ISR
 	/* Start the clock */
 	TCCR1 = TCNT1_PRESCALER_VAL;
+#endif
 }
 
+#ifdef CEC_TRANSMIT_PWM_ISR
+ISR(CEC_PWM_OVF_vect)
+{
+	if (xmit_state != XMIT_IDLE) {
+		xmit_pwm_next();
+		return;
+	}
+
+	/* Count signal free time every CEC_IDLE_US */
+	if (!cec_input_state()) {
+		transmit_high_timer = 0;
+		return;
+	}
+
+	if (transmit_high_timer < 0xff00)
+		transmit_high_timer += US_TO_JIFFIES_RND(CEC_IDLE_US);
+
+	if (transmit_high_timer >= needed_idle_time &&
+					(transmit_state & TRANSMIT_PEND))
+		xmit_start();
+}
+
+ISR(CEC_PWM_COMPA_vect)
+{
+	/* Sample point, we let go for a 1 but someone is sending a 0 */
+	if (xmit_check && !cec_input_state())
+		cec_transmit_on_error(CEC_ERR_ARB_LOST);
+}
+
+static void cec_transmit_periodic(unsigned int delta)
+{
+}
+
+static void cec_transmit_init_hw(void)
+{
+	/* OC1B is disconnected while idle, PORT keeps the line released */
+	cec_transmit_float();
+	xmit_idle();
+	OCR1A = CEC_SAMPLE_TICKS;
+	TIMSK |= _BV(TOIE1) | _BV(OCIE1A);
+	TCCR1 = TCNT1_PRESCALER_VAL;
+}
+
+static void cec_transmit_halt_hw(void)
+{
+	TIMSK &= ~(_BV(TOIE1) | _BV(OCIE1A));
+	TCCR1 = 0;
+	xmit_idle();
+}
+#else
 static void cec_transmit_periodic(unsigned int delta)
 {
 	if (xmit_state != XMIT_IDLE)
@@ -149,16 +268,7 @@ static void cec_transmit_periodic(unsigned int delta)
 		return;
 	}
 
-	/* Add, but cap at ~0xffff */
-	asm(
-		"add	%A0, %A1\n"
-		"adc	%B0, %B1\n"
-		"brcc	1f\n"
-		"ldi	%B0, 0xff\n"
-		"1:\n"
-		: "=a"(transmit_high_timer)
-		: "r"(delta), "0"(transmit_high_timer)
-	);
+	cec_add_cap(transmit_high_timer, delta);
 
 	if (transmit_high_timer < needed_idle_time)
 		return;
@@ -178,3 +288,4 @@ static void cec_transmit_init_hw(void)
 static void cec_transmit_halt_hw(void)
 {
 }
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Soft CEC transmit driver, bit-bangs the output pin from the periodic
+ * function. Like the soft receive driver, it needs a time delta passed
+ * to the periodic function.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+
+#ifndef _CEC_TRANSMIT_RAW_STATES_
+#define _CEC_TRANSMIT_RAW_STATES_
+enum {
+	XMIT_IDLE,
+	XMIT_START_LOW,
+	XMIT_START_HIGH,
+	XMIT_BIT_LOW,
+	XMIT_BIT_HIGH,
+};
+#endif
+
+/*
+ * Time since the line was last seen low while idle, or since the start
+ * of the current bit while transmitting.
+ */
+static unsigned int transmit_timer;
+static unsigned int transmit_low_time;
+static unsigned char xmit_state;
+static bool xmit_last;
+
+static void cec_transmit_abort(void)
+{
+	cec_transmit_float();
+	xmit_state = XMIT_IDLE;
+	transmit_timer = 0;
+
+	cec_transmit_finish_abort();
+}
+
+static void xmit_next_bit(void)
+{
+	bool bit;
+
+	bit = cec_transmit_get_bit();
+	xmit_last = transmit_state == TRANSMIT_WAIT_FOR_ACK;
+
+	cec_transmit_drive_low();
+	transmit_low_time = bit ? US_TO_JIFFIES_RND(CEC_1) :
+						US_TO_JIFFIES_RND(CEC_0);
+	xmit_state = XMIT_BIT_LOW;
+}
+
+static void cec_transmit_periodic(unsigned int delta)
+{
+	unsigned int idle;
+
+	cec_add_cap(transmit_timer, delta);
+
+	/*
+	 * All the edges are timed from the start of the current bit, we
+	 * only ever act late, so lateness never adds up.
+	 */
+	switch (xmit_state) {
+	case XMIT_IDLE:
+		if (!cec_input_state()) {
+			/* Someone is using the line */
+			transmit_timer = 0;
+			break;
+		}
+
+		if (!(transmit_state & TRANSMIT_PEND) ||
+				transmit_timer < needed_idle_time)
+			break;
+
+		/* The idle count is only a byte, long quiet spells stick at 255 */
+		idle = transmit_timer / US_TO_JIFFIES(CEC_PERIOD);
+		cec_transmit_start(idle > 0xff ? 0xff : idle);
+		cec_transmit_drive_low();
+		transmit_timer = 0;
+		xmit_state = XMIT_START_LOW;
+		break;
+
+	case XMIT_START_LOW:
+		if (transmit_timer >= US_TO_JIFFIES_RND(CEC_START_LOW)) {
+			cec_transmit_float();
+			xmit_state = XMIT_START_HIGH;
+		}
+		break;
+
+	case XMIT_START_HIGH:
+		if (transmit_timer >= US_TO_JIFFIES_RND(CEC_START_HIGH)) {
+			transmit_timer -= US_TO_JIFFIES_RND(CEC_START_HIGH);
+			xmit_next_bit();
+		}
+		break;
+
+	case XMIT_BIT_LOW:
+		if (transmit_timer >= transmit_low_time) {
+			cec_transmit_float();
+			xmit_state = XMIT_BIT_HIGH;
+		}
+		break;
+
+	case XMIT_BIT_HIGH:
+		if (transmit_timer < US_TO_JIFFIES_RND(CEC_PERIOD))
+			break;
+
+		transmit_timer -= US_TO_JIFFIES_RND(CEC_PERIOD);
+		if (xmit_last) {
+			/*
+			 * That was the final ack bit, the receive side has
+			 * normally told the transmit engine how it went by
+			 * now. If a late call made it miss the bit, no ack was
+			 * seen and the message goes out again. The timer now
+			 * counts signal free time.
+			 */
+			xmit_state = XMIT_IDLE;
+			if (transmit_state == TRANSMIT_WAIT_FOR_ACK)
+				cec_transmit_on_error(CEC_ERR_NACK);
+		} else
+			xmit_next_bit();
+		break;
+	}
+}
+
+static void cec_transmit_init_hw(void)
+{
+	cec_transmit_float();
+	xmit_state = XMIT_IDLE;
+	transmit_timer = 0;
+}
+
+static void cec_transmit_halt_hw(void)
+{
+	cec_transmit_init_hw();
+}
@@ -25,6 +25,7 @@
 #include <avr/interrupt.h>
 
 #include <util/atomic.h>
+#include <avr/pgmspace.h>
 
 #include "div.h"
 #include "bitops.h"
@@ -78,6 +79,35 @@ register unsigned char recv_frame_tick CEC_RECV_FRAME_TICK_REG;
 static unsigned char recv_frame_tick;
 #endif
 
+#if defined(CEC_JIFFIES) || defined(CEC_TIMERS) || defined(CEC_TOPOLOGY)
+/*
+ * Nothing else in this driver needs the delta, so callers pass 0. Count
+ * the frames instead and hand them to cec_periodic() as TCNT0 counts.
+ */
+#define CEC_DRIVER_DELTA
+#define USI_FRAME_JIFFIES	(8 * (TCNT0_TOP + 1))
+
+/* Most frames that still fit an unsigned int delta */
+#if 0xffff / USI_FRAME_JIFFIES > 255
+#define USI_FRAMES_MAX		255
+#else
+#define USI_FRAMES_MAX		(0xffff / USI_FRAME_JIFFIES)
+#endif
+
+static volatile unsigned char usi_frames;
+
+static unsigned int cec_driver_delta(void)
+{
+	unsigned char frames;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		frames = usi_frames;
+		usi_frames = 0;
+	}
+	return frames * USI_FRAME_JIFFIES;
+}
+#endif
+
 static unsigned char recv_frame;
 static unsigned char min_frame_ticks;
 static unsigned char max_frame_ticks;
@@ -88,6 +118,32 @@ static unsigned char float_ticks_max;
 static unsigned char float_ticks_max_next;
 static bool recv_last_bit;
 
+#ifdef CEC_USI_PREENCODE
+/*
+ * The next bit period of the message, worked out by cec_usi_encode()
+ * while the current one goes out. The low bits index the tables below,
+ * the ack codes also mark us as the present initiator.
+ */
+#define USI_CODE_0	0
+#define USI_CODE_1	1
+#define USI_CODE_ACK	2	/* Sent as a 1, follower may pull low */
+#define USI_CODE_LAST	3	/* Final ack bit */
+
+PROGMEM static const unsigned char usi_code_pat[] = {
+	CEC_PAT_0, CEC_PAT_1, CEC_PAT_1, CEC_PAT_1,
+};
+
+#define FLOAT_TICKS(us)	DIV_ROUND_UP((us) + CEC_MAX_RISE_TIME, SAMPLE_US)
+PROGMEM static const unsigned char usi_code_float[] = {
+	FLOAT_TICKS(CEC_0), FLOAT_TICKS(CEC_1),
+	FLOAT_TICKS(CEC_0), FLOAT_TICKS(CEC_0),
+};
+
+static unsigned char usi_xmit_code;
+static unsigned char usi_xmit_pos;	/* Byte of transmit_buf */
+static unsigned char usi_xmit_bit;	/* Bit period within it, 0-9 */
+#endif
+
 #define FLAG1_CEC_USI_NACKING	0
 #define FLAG1_CEC_USI_ACK_DONE	1
 
@@ -96,6 +152,8 @@ static void cec_process_tick(bool bit_state)
 {
 	unsigned char recv_state = usi_recv_state;
 
+	cec_probe_enter(CEC_PROBE_TICK);
+
 	if (++recv_frame_tick == 0)
 		recv_frame_tick = 255;
 
@@ -154,8 +212,69 @@ static void cec_process_tick(bool bit_state)
 
 	usi_recv_state = recv_state;
 	recv_last_bit = bit_state;
+	cec_probe_exit(CEC_PROBE_TICK);
 }
 
+#ifdef CEC_USI_EDGE_TABLE
+/*
+ * Number of samples before the first edge in a frame, indexed by a mask
+ * of the edges in the frame (MSB first, 8 if there are none). The edge
+ * mask is the sample byte XORed with itself delayed by one sample, with
+ * the previous frame's last sample shifted in at the top.
+ */
+PROGMEM static const unsigned char cec_usi_edge_pos[256] = {
+	8, 7, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 4,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+/* Process n 300uS time periods with no transition */
+static void cec_process_ticks(unsigned char n)
+{
+	unsigned char tick = recv_frame_tick;
+	unsigned char end = tick + n;
+
+	if (end < tick)
+		end = 255;
+
+	if (usi_recv_state == USI_RECV_BITS &&
+			tick < CEC_NOM_SAMPLE / SAMPLE_US &&
+			end >= CEC_NOM_SAMPLE / SAMPLE_US) {
+		/* We passed through the sample window */
+		recv_frame_tick = CEC_NOM_SAMPLE / SAMPLE_US;
+		cec_receive_bit(recv_last_bit);
+		if (!cec_receive_flags)
+			usi_recv_state = USI_RECV_IDLE;
+	}
+
+	if (end > max_frame_ticks) {
+		/*
+		 * Too much time passed with no transition. The tick by tick
+		 * loop would report this once per tick, but after the first
+		 * report there is no receive in progress and the rest are
+		 * ignored.
+		 */
+		cec_receive_error(CEC_ERR_NO_EOM);
+		usi_recv_state = USI_RECV_IDLE;
+	}
+
+	recv_frame_tick = end;
+}
+#endif
+
 static void cec_transmit_abort(void)
 {
 	unsigned char sr;
@@ -202,7 +321,9 @@ static unsigned char cec_usi_next_bit(void)
 #else
 static unsigned char cec_usi_next_bit(void)
 {
+#ifndef CEC_USI_PREENCODE
 	bool bit;
+#endif
 	unsigned char ret;
 	unsigned char state = usi_xmit_state;
 
@@ -214,7 +335,11 @@ static unsigned char cec_usi_next_bit(void)
 		 */
 		if ((transmit_state & TRANSMIT_PEND) &&
 				idle_frames >= needed_idle_frames) {
-			cec_transmit_start();
+#ifdef CEC_USI_PREENCODE
+			usi_xmit_pos = 0;
+			usi_xmit_bit = 0;
+#endif
+			cec_transmit_start(idle_frames);
 			float_ticks_max_next = 8;
 			state = USI_XMIT_START;
 			ret = CEC_PAT_START0;
@@ -230,6 +355,26 @@ static unsigned char cec_usi_next_bit(void)
 		break;
 
 	default:
+#ifdef CEC_USI_PREENCODE
+	{
+		unsigned char code = usi_xmit_code;
+
+		ret = pgm_read_byte(&usi_code_pat[code]);
+		float_ticks_max_next = pgm_read_byte(&usi_code_float[code]);
+
+		/* Keep the cross-check with the receive side going */
+		transmit_last_bit = (transmit_last_bit << 1) | (code != USI_CODE_0);
+
+		if (code >= USI_CODE_ACK) {
+			/* Consider us the present initiator */
+			needed_idle_frames = CEC_PRESENT_PERIOD_WAIT;
+			if (code == USI_CODE_LAST) {
+				transmit_state = TRANSMIT_WAIT_FOR_ACK;
+				state = USI_XMIT_IDLE;
+			}
+		}
+	}
+#else
 		bit = cec_transmit_get_bit();
 		if (transmit_state == TRANSMIT_WAIT_FOR_ACK)
 			state = USI_XMIT_IDLE;
@@ -239,12 +384,44 @@ static unsigned char cec_usi_next_bit(void)
 			DIV_ROUND_UP(CEC_0 + CEC_MAX_RISE_TIME, SAMPLE_US);
 
 		ret = bit ? CEC_PAT_1 : CEC_PAT_0;
+#endif
 	}
 	usi_xmit_state = state;
 	return ret;
 }
 #endif
 
+#if defined(CEC_USI_PREENCODE) && !CEC_MONITOR
+/* Work out the bit period after the one just loaded into USIBR */
+static void cec_usi_encode(void)
+{
+	unsigned char pos = usi_xmit_pos;
+	unsigned char bit = usi_xmit_bit;
+	bool last = pos == transmit_buf_end;
+
+	if (usi_xmit_state != USI_XMIT_BITS)
+		return;
+
+	if (bit < 8)
+		usi_xmit_code = (transmit_buf[pos] << bit) & 0x80 ?
+						USI_CODE_1 : USI_CODE_0;
+	else if (bit == 8)
+		/* EOM, we don't EOM ping messages */
+		usi_xmit_code = last && pos ? USI_CODE_1 : USI_CODE_0;
+	else
+		usi_xmit_code = last ? USI_CODE_LAST : USI_CODE_ACK;
+
+	if (++bit == 10) {
+		bit = 0;
+		pos++;
+	}
+	usi_xmit_pos = pos;
+	usi_xmit_bit = bit;
+}
+#else
+#define cec_usi_encode()	do {} while (0)
+#endif
+
 static void cec_transmit_periodic(unsigned int delta)
 {
 }
@@ -254,6 +431,44 @@ static void cec_transmit_periodic(unsigned int delta)
  * we find out pretty late that we need to send an ack so we need to
  * inject it.
  */
+#ifdef CEC_HOST
+/* Same steps as the asm version below, nothing can interrupt us here */
+static void cec_receive_do_ack(signed char acks)
+{
+	unsigned char bits = USISR & 7;
+	unsigned char n = bits;
+	unsigned char dr = USIDR;
+	unsigned char ack_bits;
+	signed char pos;
+
+	/* Ticks that already went by high come off the ack count */
+	while (n) {
+		bool high = dr & 1;
+
+		dr >>= 1;
+		if (!high)
+			break;
+		if (!--acks)
+			return;
+		n--;
+	}
+
+	/* Fill the bits of USIDR yet to be shifted out */
+	ack_bits = 0x80;
+	for (pos = bits - 8; --acks && ++pos; )
+		ack_bits = (ack_bits >> 1) | 0x80;
+	USIDR |= ack_bits;
+
+	if (!acks)
+		return;
+
+	/* The rest go in USIBR */
+	ack_bits = 0x80;
+	while (--acks)
+		ack_bits = (ack_bits >> 1) | 0x80;
+	USIBR = ack_bits;
+}
+#else
 static void cec_receive_do_ack(signed char acks)
 {
 	unsigned char reg1 = TCNT0_TOP - 1;
@@ -271,6 +486,7 @@ static void cec_receive_do_ack(signed char acks)
 	asm(
 "	in r23, %[sreg]\n"
 "	cli\n"
+	CEC_ASM_PROBE_ENTER(CEC_PROBE_ACK)
 "	out %[tccr0b], __zero_reg__\n"
 
 	/*
@@ -338,6 +554,7 @@ static void cec_receive_do_ack(signed char acks)
 	 * Critical section done, we should have quite a long time before
 	 * USIBR is overwritten.
 	 */
+	CEC_ASM_PROBE_EXIT(CEC_PROBE_ACK)
 "	out %[sreg], r23\n"
 "	out %[tccr0b], %[tcnt0_prescaler_val]\n"
 
@@ -361,6 +578,7 @@ static void cec_receive_do_ack(signed char acks)
 
 "done:\n"
 "	out %[tccr0b], %[tcnt0_prescaler_val]\n"
+	CEC_ASM_PROBE_EXIT(CEC_PROBE_ACK)
 "	out %[sreg], r23\n"
 	:
 	:	[usidr] "I"(_SFR_IO_ADDR(USIDR)),
@@ -369,36 +587,57 @@ static void cec_receive_do_ack(signed char acks)
 		[tcnt0] "I"(_SFR_IO_ADDR(TCNT0)),
 		[tccr0b] "I"(_SFR_IO_ADDR(TCCR0B)),
 		[sreg] "I"(_SFR_IO_ADDR(SREG)),
+		[probe_io] "I"(CEC_PROBE_IO),
 		[tcnt0_prescaler_val] "r"(pre),
 		[acks] "r"(acks),
 		[reg1] "r"(reg1)
 	:	"r21", "r22", "r23"
 	);
 }
+#endif
 
-static void cec_receive_periodic(unsigned short delta)
+/* Handle outgoing acks */
+static void cec_usi_ack(void)
 {
-	unsigned char buf;
-	unsigned char bit;
-	unsigned char tick;
-	unsigned char frames;
-
-	buf = USISR;
+	if (!(GPIOR1 & _BV(FLAG1_CEC_USI_ACK_DONE)) &&
+		(cec_receive_flags & CEC_RECV_DO_ACK) && !cec_input_state()) {
+		signed char acks = 0;
+		unsigned char ticks = recv_frame_tick;
+		ticks += USISR & 7;
+		/* We want to ack for up to 5 ticks, or 1500uS */
 
-	if (buf & _BV(USIOIF))
-		float_ticks_max = float_ticks_max_next;
+		if (recv_frame == 9 * 8 && recv_frame_tick < 4) {
+			/*
+			 * We are already pretty late, maybe we can get
+			 * something out.
+		 	 */
+			acks = 4 - recv_frame_tick;
+		} else if (recv_frame == 8 * 8 &&
+				ticks >= MAX_TICKS(CEC_T6_LATE0)) {
+			acks = 5;
+		} else
+			return;
 
-	tick = buf & 0x7;
-	if (!cec_input_state() && tick >= float_ticks_max)
-		/* Line was driven by another host */
-		cec_transmit_on_error(CEC_ERR_ARB_LOST);
+		GPIOR1 |= _BV(FLAG1_CEC_USI_ACK_DONE);
+		cec_receive_do_ack(acks);
+	}
+}
 
-	if (!(buf & _BV(USIOIF)))
-		goto out;
+/* USI counter overflowed, we have a new frame worth of samples */
+static void cec_usi_overflow(void)
+{
+	unsigned char buf;
+	unsigned char bit;
+	unsigned char frames;
 
 	/* Provide a tick every 2.4ms */
 	cec_usi_frame_hook();
 
+#ifdef CEC_DRIVER_DELTA
+	if (usi_frames < USI_FRAMES_MAX)
+		usi_frames++;
+#endif
+
 	/* We nack for at least one full frame */
 	if (!(GPIOR1 & _BV(FLAG1_CEC_USI_NACKING)))
 		cec_receive_float();
@@ -415,42 +654,100 @@ static void cec_receive_periodic(unsigned short delta)
 		frames = 255;
 	idle_frames = frames;
 
-	for (bit = 0; bit < 8; bit++) {
+#ifdef CEC_USI_EDGE_TABLE
+	/* Handle everything up to the first edge in one go */
+	bit = pgm_read_byte(&cec_usi_edge_pos[(unsigned char)
+		(buf ^ ((buf >> 1) | (recv_last_bit ? 0 : 0x80)))]);
+	if (bit) {
+		cec_process_ticks(bit);
+		buf <<= bit;
+	}
+#else
+	bit = 0;
+#endif
+	for (; bit < 8; bit++) {
 		cec_process_tick(!(buf & 0x80));
 		buf <<= 1;
 	}
 
 	/* Write out data */
+	cec_probe_enter(CEC_PROBE_REFILL);
 	USIBR = cec_usi_next_bit();
+	cec_probe_exit(CEC_PROBE_REFILL);
 	USISR |= 8;
 	USISR |= _BV(USIOIF);
 
-out:
-	/* Handle outgoing acks */
-	if (!(GPIOR1 & _BV(FLAG1_CEC_USI_ACK_DONE)) &&
-		(cec_receive_flags & CEC_RECV_DO_ACK) && !cec_input_state()) {
-		signed char acks = 0;
-		unsigned char ticks = recv_frame_tick;
-		ticks += USISR & 7;
-		/* We want to ack for up to 5 ticks, or 1500uS */
+	/* Get the next one ready while there is time */
+	cec_usi_encode();
+}
 
-		if (recv_frame == 9 * 8 && recv_frame_tick < 4) {
-			/*
-			 * We are already pretty late, maybe we can get
-			 * something out.
-		 	 */
-			acks = 4 - recv_frame_tick;
-		} else if (recv_frame == 8 * 8 &&
-				ticks >= MAX_TICKS(CEC_T6_LATE0)) {
-			acks = 5;
-		} else
-			return;
+#ifdef CEC_USI_ISR
+/*
+ * Interrupt driven mode. The USI counter overflow interrupt does the
+ * per-frame work and a pin change interrupt on the input pin catches
+ * arbitration loss and the start of ack bits as they happen, so none of
+ * it depends on how often cec_periodic is called.
+ */
+#ifndef CEC_USI_OVF_vect
+#define CEC_USI_OVF_vect	USI_OVF_vect
+#endif
+#ifndef CEC_USI_PCINT_vect
+#define CEC_USI_PCINT_vect	PCINT0_vect
+#endif
+#ifndef CEC_USI_PCMSK
+#define CEC_USI_PCMSK		PCMSK
+#endif
+#ifndef CEC_USI_PCIE
+#define CEC_USI_PCIE		GIMSK |= _BV(PCIE)
+#endif
 
-		GPIOR1 |= _BV(FLAG1_CEC_USI_ACK_DONE);
-		cec_receive_do_ack(acks);
-	}
+ISR(CEC_USI_OVF_vect)
+{
+	float_ticks_max = float_ticks_max_next;
+	cec_usi_overflow();
+	cec_usi_ack();
 }
 
+ISR(CEC_USI_PCINT_vect)
+{
+	cec_probe_enter(CEC_PROBE_PCINT);
+	/*
+	 * The line going low after we stopped driving it means someone
+	 * else is holding it, the rising edges are just us letting go.
+	 */
+	if (!cec_input_state() && (USISR & 7) >= float_ticks_max)
+		cec_transmit_on_error(CEC_ERR_ARB_LOST);
+
+	cec_usi_ack();
+	cec_probe_exit(CEC_PROBE_PCINT);
+}
+
+static void cec_receive_periodic(unsigned short delta)
+{
+}
+#else
+static void cec_receive_periodic(unsigned short delta)
+{
+	unsigned char buf;
+	unsigned char tick;
+
+	buf = USISR;
+
+	if (buf & _BV(USIOIF))
+		float_ticks_max = float_ticks_max_next;
+
+	tick = buf & 0x7;
+	if (!cec_input_state() && tick >= float_ticks_max)
+		/* Line was driven by another host */
+		cec_transmit_on_error(CEC_ERR_ARB_LOST);
+
+	if (buf & _BV(USIOIF))
+		cec_usi_overflow();
+
+	cec_usi_ack();
+}
+#endif
+
 static void cec_transmit_halt_hw(void)
 {
 	USIBR = 0;
@@ -459,6 +756,10 @@ static void cec_transmit_halt_hw(void)
 
 static void cec_receive_halt_hw(void)
 {
+#ifdef CEC_USI_ISR
+	USICR &= ~_BV(USIOIE);
+	CEC_USI_PCMSK &= ~_BV(CEC_PBIN);
+#endif
 	cec_receive_float();
 }
 
@@ -473,7 +774,13 @@ static void cec_receive_init(void)
 	USISR = _BV(USIOIF) | 8;
 
 	/* Select Three-wire mode and Timer/Counter0 Compare Match clock */
+#ifdef CEC_USI_ISR
+	USICR = _BV(USIOIE) | _BV(USIWM0) | _BV(USICS0);
+	CEC_USI_PCMSK |= _BV(CEC_PBIN);
+	CEC_USI_PCIE;
+#else
 	USICR = _BV(USIWM0) | _BV(USICS0);
+#endif
 
 	OCR0A = TCNT0_TOP;
 
@@ -0,0 +1,51 @@
+/*
+ * Host stand-in for avr/eeprom.h. Like the register file, each
+ * translation unit gets its own erased EEPROM, which keeps its contents
+ * for as long as the process runs. Writes finish immediately.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#ifndef _HOST_AVR_EEPROM_H_
+#define _HOST_AVR_EEPROM_H_
+
+#include <stdint.h>
+
+/* ATtiny85 */
+#define E2END		511
+
+static uint8_t host_eeprom[E2END + 1] __attribute__((unused)) = {
+	[0 ... E2END] = 0xff
+};
+
+/* Writes done to each byte, for checking the wear levelling */
+static unsigned long host_eeprom_writes[E2END + 1] __attribute__((unused));
+
+#define eeprom_is_ready()	1
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p)
+{
+	return host_eeprom[(uintptr_t) p];
+}
+
+static inline void eeprom_write_byte(uint8_t *p, uint8_t value)
+{
+	host_eeprom[(uintptr_t) p] = value;
+	host_eeprom_writes[(uintptr_t) p]++;
+}
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Simulated ATtiny85 register file for host builds, or the ATmega328P
+ * Timer1 in its place if __AVR_ATmega328P__ is defined. Every translation
+ * unit that includes this gets its own copy of the registers, so each
+ * one that includes cec.c is a separate node with its own pins and
+ * peripherals. Nothing here behaves like hardware on its own, whatever
+ * drives the build sets the input registers and calls the interrupt
+ * vectors.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#ifndef _HOST_AVR_IO_H_
+#define _HOST_AVR_IO_H_
+
+#define _BV(bit)	(1 << (bit))
+
+/* avr-gcc builtin, wider here but nothing depends on the wrap */
+typedef unsigned long __uint24;
+
+#define HOST_REG(name) \
+	static volatile unsigned char name __attribute__((unused))
+
+HOST_REG(SREG);
+HOST_REG(GPIOR0);
+HOST_REG(GPIOR1);
+HOST_REG(GPIOR2);
+HOST_REG(MCUSR);
+
+/* Port B */
+HOST_REG(PINB);
+HOST_REG(DDRB);
+HOST_REG(PORTB);
+
+#define PB0	0
+#define PB1	1
+#define PB2	2
+#define PB3	3
+#define PB4	4
+#define PB5	5
+
+/* Pin change and external interrupts */
+HOST_REG(GIMSK);
+HOST_REG(GIFR);
+HOST_REG(PCMSK);
+
+#define INT0	6
+#define PCIE	5
+#define INTF0	6
+#define PCIF	5
+
+/* USI */
+HOST_REG(USIDR);
+HOST_REG(USIBR);
+HOST_REG(USISR);
+HOST_REG(USICR);
+
+#define USISIF	7
+#define USIOIF	6
+#define USIPF	5
+#define USIDC	4
+
+#define USISIE	7
+#define USIOIE	6
+#define USIWM1	5
+#define USIWM0	4
+#define USICS1	3
+#define USICS0	2
+#define USICLK	1
+#define USITC	0
+
+/* Timer0 */
+HOST_REG(TCCR0A);
+HOST_REG(TCCR0B);
+HOST_REG(TCNT0);
+HOST_REG(OCR0A);
+HOST_REG(OCR0B);
+
+#define COM0A1	7
+#define COM0A0	6
+#define COM0B1	5
+#define COM0B0	4
+#define WGM01	1
+#define WGM00	0
+
+#define FOC0A	7
+#define FOC0B	6
+#define WGM02	3
+#define CS02	2
+#define CS01	1
+#define CS00	0
+
+#ifdef __AVR_ATmega328P__
+/* Timer1, 16 bits with input capture */
+static volatile unsigned short TCNT1 __attribute__((unused));
+static volatile unsigned short OCR1A __attribute__((unused));
+static volatile unsigned short OCR1B __attribute__((unused));
+static volatile unsigned short ICR1 __attribute__((unused));
+HOST_REG(TCCR1A);
+HOST_REG(TCCR1B);
+HOST_REG(TIMSK1);
+HOST_REG(TIFR1);
+
+/*
+ * Writing FOC1B applies the COM1B action at once, which a plain variable
+ * can't do. Each write latches the COM1B bits as they were, with bit 0
+ * set, and whatever drives the build applies them once it gets control
+ * back.
+ */
+HOST_REG(host_foc1b);
+HOST_REG(host_tccr1c);
+#define TCCR1C \
+	host_foc1b = (TCCR1A & (_BV(COM1B1) | _BV(COM1B0))) | 1, host_tccr1c
+
+#define COM1A1	7
+#define COM1A0	6
+#define COM1B1	5
+#define COM1B0	4
+#define WGM11	1
+#define WGM10	0
+
+#define ICNC1	7
+#define ICES1	6
+#define WGM13	4
+#define WGM12	3
+#define CS12	2
+#define CS11	1
+#define CS10	0
+
+#define FOC1A	7
+#define FOC1B	6
+
+#define ICIE1	5
+#define OCIE1B	2
+#define OCIE1A	1
+#define TOIE1	0
+
+#define ICF1	5
+#define OCF1B	2
+#define OCF1A	1
+#define TOV1	0
+#else
+/* Timer1 */
+HOST_REG(TCCR1);
+HOST_REG(GTCCR);
+HOST_REG(TCNT1);
+HOST_REG(OCR1A);
+HOST_REG(OCR1B);
+HOST_REG(OCR1C);
+
+#define CTC1	7
+#define PWM1A	6
+#define COM1A1	5
+#define COM1A0	4
+#define CS13	3
+#define CS12	2
+#define CS11	1
+#define CS10	0
+
+#define TSM	7
+#define PWM1B	6
+#define COM1B1	5
+#define COM1B0	4
+#define FOC1B	3
+#define FOC1A	2
+#define PSR1	1
+#define PSR0	0
+
+/* Timer interrupts */
+HOST_REG(TIMSK);
+HOST_REG(TIFR);
+
+#define OCIE1A	6
+#define OCIE1B	5
+#define OCIE0A	4
+#define OCIE0B	3
+#define TOIE1	2
+#define TOIE0	1
+
+#define OCF1A	6
+#define OCF1B	5
+#define OCF0A	4
+#define OCF0B	3
+#define TOV1	2
+#define TOV0	1
+#endif
+
+#endif
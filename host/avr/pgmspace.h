@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for avr/pgmspace.h, flash is just memory.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#ifndef _HOST_AVR_PGMSPACE_H_
+#define _HOST_AVR_PGMSPACE_H_
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)			(s)
+#define pgm_read_byte(p)	(*(const unsigned char *) (p))
+#define pgm_read_word(p)	(*(const unsigned short *) (p))
+#define pgm_read_ptr(p)		(*(void * const *) (p))
+#define memcpy_P		memcpy
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * Host benchmark and fuzzer for the protocol engines and the hardware
+ * drivers, built natively against the simulated register file. The
+ * Makefile builds one binary per driver, each runs:
+ *
+ *  - Receive engine throughput, frames pushed through cec_receive_bit
+ *  - Transmit engine throughput, frames pulled out of cec_transmit_get_bit
+ *  - Engine fuzzing, random calls into both engines checking their state
+ *  - Driver fuzzing, random line activity into the driver
+ *
+ * Usage: cec_bench_<driver> [frames] [seed]
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CEC_DDR		DDRB
+#define CEC_PIN		PINB
+#define CEC_PORT	PORTB
+#define CEC_PBIN	PB0
+#define CEC_PBOUT	PB1
+
+#define CEC_FIXED_LOGICAL_ADDRESS	CEC_ADDR_PLAYBACK_DEVICE_1
+
+#include "../cec.c"
+
+#ifdef CEC_USI
+static void cec_usi_frame_hook(void)
+{
+}
+#endif
+
+static unsigned long bench_frames = 1000000;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double start, unsigned long n,
+							const char *unit)
+{
+	double secs = now() - start;
+
+	printf("%-12s %11.0f %s/s %8.2f ns/%s\n", name, n / secs, unit,
+							secs * 1e9 / n, unit);
+}
+
+static void fail(const char *what, unsigned long n)
+{
+	fprintf(stderr, "%s at iteration %lu\n", what, n);
+	exit(1);
+}
+
+/* Random frame addressed to us, from a random initiator */
+static unsigned char random_frame(unsigned char *buf)
+{
+	unsigned char len = 1 + rand() % CEC_BUFFER_SIZE;
+	unsigned char i;
+
+	buf[0] = (rand() & 0xf0) | CEC_FIXED_LOGICAL_ADDRESS;
+	for (i = 1; i < len; i++)
+		buf[i] = rand();
+	return len;
+}
+
+static void bench_receive(void)
+{
+	unsigned char buf[CEC_BUFFER_SIZE];
+	unsigned long bits = 0;
+	unsigned long n;
+	unsigned char len;
+	unsigned char i;
+	signed char b;
+	double start;
+
+	len = random_frame(buf);
+	start = now();
+	for (n = 0; n < bench_frames; n++) {
+		cec_receive_start();
+		for (i = 0; i < len; i++) {
+			for (b = 7; b >= 0; b--)
+				cec_receive_bit((buf[i] >> b) & 1);
+			cec_receive_bit(i == len - 1);
+			/* Our own ack */
+			cec_receive_bit(false);
+		}
+		bits += len * 10;
+
+		if (cec_receive_buf[0] != len ||
+				memcmp(&cec_receive_buf[1], buf, len))
+			fail("receive mismatch", n);
+		cec_receive_release();
+	}
+	report("receive", start, bench_frames, "frame");
+	report("", start, bits, "bit");
+}
+
+static void bench_transmit(void)
+{
+	unsigned char buf[CEC_BUFFER_SIZE];
+	unsigned long bits = 0;
+	unsigned long n;
+	unsigned char len;
+	unsigned char i;
+	unsigned char out;
+	double start;
+
+	len = random_frame(buf);
+	start = now();
+	for (n = 0; n < bench_frames; n++) {
+		memcpy(transmit_buf, buf, len);
+		transmit_buf_end = len - 1;
+		transmit_state = TRANSMIT_PEND;
+		cec_transmit_start(CEC_NEW_PERIOD_WAIT);
+
+		out = 0;
+		for (i = 0; transmit_state != TRANSMIT_WAIT_FOR_ACK; i++) {
+			bool bit = cec_transmit_get_bit();
+
+			/* Check the first byte goes out as it should */
+			if (i < 8)
+				out = (out << 1) | bit;
+		}
+		bits += i;
+		cec_transmit_receive_ack(true);
+
+		if (out != buf[0] || i != len * 10 ||
+				transmit_state != TRANSMIT_IDLE)
+			fail("transmit mismatch", n);
+	}
+	report("transmit", start, bench_frames, "frame");
+	report("", start, bits, "bit");
+}
+
+static void check_engines(unsigned long n)
+{
+	unsigned char hdr = cec_receive_buf[0];
+
+	if (cec_receive_flags && !(cec_receive_flags & CEC_RECV_ACTIVE))
+		fail("receive flags", n);
+	if ((hdr & 0x3f) > CEC_BUFFER_SIZE && !(hdr & CEC_STATUS_OVERRUN))
+		fail("receive length", n);
+	if (transmit_state > TRANSMIT_IDLE && transmit_state < TRANSMIT_PEND &&
+			transmit_state != TRANSMIT_FAILED)
+		fail("transmit state", n);
+	if (transmit_state > TRANSMIT_AGAIN &&
+			transmit_buf_pos > transmit_buf_end)
+		fail("transmit position", n);
+}
+
+static void fuzz_engines(void)
+{
+	unsigned long n;
+	double start;
+
+	start = now();
+	for (n = 0; n < bench_frames * 10; n++) {
+		switch (rand() % 16) {
+		case 0:
+			cec_receive_start();
+			break;
+		case 1:
+			cec_receive_error(1 + rand() % CEC_ERR_HW);
+			break;
+		case 2:
+			cec_receive_release();
+			break;
+		case 3:
+			if (transmit_state < TRANSMIT_PEND) {
+				transmit_buf_end = rand() % CEC_BUFFER_SIZE;
+				transmit_buf[0] = rand();
+				transmit_state = TRANSMIT_PEND;
+			} else if (transmit_state <= TRANSMIT_AGAIN)
+				cec_transmit_start(rand() % 10);
+			break;
+		case 4:
+			cec_transmit_receive_ack(rand() & 1);
+			break;
+		case 5:
+		case 6:
+		case 7:
+			if (transmit_state > TRANSMIT_AGAIN &&
+					transmit_state != TRANSMIT_WAIT_FOR_ACK)
+				cec_transmit_get_bit();
+			break;
+		default:
+			/* Drivers only pass bits on inside a frame */
+			if (cec_receive_flags)
+				cec_receive_bit(rand() & 1);
+			break;
+		}
+		check_engines(n);
+	}
+	report("fuzz engine", start, n, "call");
+}
+
+static void fuzz_driver(void)
+{
+	unsigned long n;
+	unsigned char run = 0;
+	bool high = true;
+	bool edge;
+#ifndef CEC_USI
+	unsigned char delta;
+#endif
+	double start;
+
+	cec_init();
+	start = now();
+	for (n = 0; n < bench_frames * 10; n++) {
+		edge = !run--;
+		if (edge) {
+			/* Hold the line for a random stretch */
+			high = !high;
+			run = rand() % 24;
+		}
+		PINB = high ? 0 : _BV(CEC_PBIN);
+
+		if (transmit_state < TRANSMIT_PEND && !(rand() % 64)) {
+			transmit_buf[0] = cec_addr_build(0, rand() & 0xf);
+			transmit_buf_end = 0;
+			transmit_state = TRANSMIT_PEND;
+		}
+		if (cec_receive_buf[0])
+			cec_receive_release();
+
+#ifdef CEC_USI
+		USIBR = high ? 0 : (rand() % 24 ? 0xff : rand());
+		USISR = (rand() & 7) | (rand() % 8 ? 0 : _BV(USIOIF));
+		cec_periodic(0);
+#else
+		delta = 1 + rand() % 16;
+#ifdef CEC_RECEIVE_PCINT
+		if (edge && (CEC_RECEIVE_PCMSK & _BV(CEC_PBIN)))
+			CEC_RECEIVE_PCINT_vect();
+		if ((CEC_RECEIVE_TIMSK & _BV(OCIE0B)) &&
+		    (unsigned char) (OCR0B - TCNT0) < delta)
+			/* Compare match before the next call */
+			CEC_RECEIVE_COMPB_vect();
+		TCNT0 += delta;
+#endif
+		cec_periodic(delta);
+#endif
+		check_engines(n);
+	}
+	report("fuzz driver", start, n, "tick");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		bench_frames = strtoul(argv[1], NULL, 0);
+	srand(argc > 2 ? strtoul(argv[2], NULL, 0) : 1);
+
+	bench_receive();
+	bench_transmit();
+	fuzz_engines();
+	fuzz_driver();
+
+	return 0;
+}
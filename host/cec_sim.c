@@ -0,0 +1,504 @@
+/*
+ * Multi-node CEC bus simulator. Up to 15 nodes, each its own copy of the
+ * library, share an open-drain wired-AND line. Every node has its own
+ * clock skew and cec_periodic jitter. Edges take the rise and fall
+ * times to ramp and the nodes see the new level half way through. All
+ * randomness comes from the seed, the same arguments always give the
+ * same run.
+ *
+ * Usage: cec_sim [-n nodes] [-d usi|raw|icp|mix|all] [-t seconds]
+ *		[-s seed] [-k skew_ppm] [-p period_us] [-j jitter_us]
+ *		[-r rise_us] [-f fall_us] [-m msg_interval_ms]
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "../cec.h"
+#include "../cec_spec.h"
+
+#define US	1000ULL
+#define MS	1000000ULL
+
+#define SIM_SLOT(n)	{ &sim_usi_##n, &sim_raw_##n, &sim_icp_##n }
+
+static const struct sim_node_ops *slot_ops[SIM_SLOTS][3] = {
+	SIM_SLOT(0), SIM_SLOT(1), SIM_SLOT(2), SIM_SLOT(3), SIM_SLOT(4),
+	SIM_SLOT(5), SIM_SLOT(6), SIM_SLOT(7), SIM_SLOT(8), SIM_SLOT(9),
+	SIM_SLOT(10), SIM_SLOT(11), SIM_SLOT(12), SIM_SLOT(13), SIM_SLOT(14),
+};
+
+#define SIM_ALLOC(n)	{ { &sim_usi_alloc_##n, &sim_raw_alloc_##n }, \
+			  { &sim_usi_cache_##n, &sim_raw_cache_##n } }
+
+/* Indexed by slot, EEPROM cache, driver */
+static const struct sim_node_ops *alloc_ops[SIM_ALLOC_SLOTS][2][2] = {
+	SIM_ALLOC(0), SIM_ALLOC(1), SIM_ALLOC(2), SIM_ALLOC(3), SIM_ALLOC(4),
+	SIM_ALLOC(5),
+};
+
+struct sim_node {
+	const struct sim_node_ops *ops;
+	long skew_ppm;
+	bool pulls_low;
+
+	/* Global times of the next events */
+	unsigned long long next_hw;
+	unsigned long long next_periodic;
+	unsigned long long next_send;
+
+	/* Message going out */
+	bool sending;
+	unsigned long long queued;
+
+	/* Results */
+	unsigned long sent;
+	unsigned long failed;
+	unsigned long received;
+	unsigned long errs[7];
+	unsigned long long latency_sum;
+	unsigned long long latency_max;
+
+	/* Address allocation, the first one after power up is cold */
+	bool allocating;
+	unsigned long long booted;
+	unsigned long long next_reboot;
+	unsigned long long cold;
+	unsigned long warm;
+	unsigned long long warm_sum;
+	unsigned long long warm_max;
+};
+
+static struct sim_node nodes[SIM_SLOTS];
+static unsigned char node_count = 4;
+
+/* Settings */
+static unsigned long long run_ns = 10000 * MS;
+static long skew_ppm = 2000;
+static unsigned long long period_ns = 50 * US;
+static unsigned long long jitter_ns = 25 * US;
+static unsigned long long rise_ns = CEC_MAX_RISE_TIME * US;
+static unsigned long long fall_ns = CEC_MAX_FALL_TIME * US;
+static unsigned long long msg_ns = 1000 * MS;
+static bool alloc;
+static bool alloc_cache;
+static unsigned long long reboot_ns = 3000 * MS;
+
+/* Bus state, level is what the nodes see */
+static unsigned long long now;
+static bool bus_high = true;
+static bool bus_target = true;
+static unsigned long long bus_change = ~0ULL;
+static unsigned long long low_total;
+static unsigned long long low_start;
+static unsigned long long busy_total;
+static unsigned long long busy_start;
+static unsigned long long busy_end;
+
+static unsigned long long rand_state;
+
+static unsigned long long sim_rand(void)
+{
+	/* xorshift64* */
+	rand_state ^= rand_state >> 12;
+	rand_state ^= rand_state << 25;
+	rand_state ^= rand_state >> 27;
+	return rand_state * 2685821657736338717ULL;
+}
+
+static unsigned long long rand_range(unsigned long long n)
+{
+	return n ? sim_rand() % n : 0;
+}
+
+/* Global time for an interval on the node's own clock */
+static unsigned long long node_interval(struct sim_node *n,
+						unsigned long long local)
+{
+	return local * 1000000 / (1000000 + n->skew_ppm);
+}
+
+static unsigned long long node_time(struct sim_node *n)
+{
+	return now + (long long) now * n->skew_ppm / 1000000;
+}
+
+static void bus_update(void)
+{
+	bool high = true;
+	unsigned char i;
+
+	for (i = 0; i < node_count; i++)
+		if (nodes[i].pulls_low)
+			high = false;
+
+	if (high == bus_target)
+		return;
+
+	bus_target = high;
+	if (high == bus_high)
+		/* Pulse shorter than the edge, never seen */
+		bus_change = ~0ULL;
+	else
+		/* Edges ramp linearly, inputs switch half way */
+		bus_change = now + (high ? rise_ns : fall_ns) / 2;
+}
+
+static void node_update(struct sim_node *n)
+{
+	bool low = n->ops->pulls_low();
+
+	if (low != n->pulls_low) {
+		n->pulls_low = low;
+		bus_update();
+	}
+}
+
+static void bus_edge(void)
+{
+	unsigned char i;
+
+	bus_high = bus_target;
+	bus_change = ~0ULL;
+
+	if (bus_high) {
+		low_total += now - low_start;
+		busy_end = now + CEC_PERIOD * US;
+	} else {
+		low_start = now;
+		if (now > busy_end) {
+			busy_total += busy_end - busy_start;
+			busy_start = now;
+		}
+		busy_end = ~0ULL;
+	}
+
+	for (i = 0; i < node_count; i++) {
+		nodes[i].ops->line(bus_high);
+		node_update(&nodes[i]);
+	}
+}
+
+static void node_send(struct sim_node *n)
+{
+	unsigned char buf[4];
+	unsigned char len = 1 + rand_range(sizeof(buf));
+	unsigned char addr = n->ops->addr();
+	unsigned char target;
+	unsigned char i;
+
+	if (addr == 0xff)
+		/* Still allocating */
+		return;
+
+	/* One in ten are broadcast */
+	target = rand_range(10) ? nodes[rand_range(node_count)].ops->addr() :
+							CEC_ADDR_BROADCAST;
+	if (target == addr || target == 0xff)
+		target = CEC_ADDR_BROADCAST;
+
+	buf[0] = (addr << 4) | target;
+	for (i = 1; i < len; i++)
+		buf[i] = sim_rand();
+
+	if (n->ops->send(buf, len)) {
+		n->sending = true;
+		n->queued = now;
+	}
+}
+
+/* The app side of the node, after each cec_periodic */
+static void node_app(struct sim_node *n)
+{
+	unsigned char buf[16];
+	unsigned char errs[7];
+	unsigned char i;
+
+	if (alloc && now >= n->next_reboot) {
+		n->ops->reboot();
+		n->sending = false;
+		n->allocating = true;
+		n->booted = now;
+		n->next_reboot = now + reboot_ns / 2 + rand_range(reboot_ns);
+	}
+
+	if (n->allocating && n->ops->addr() != 0xff) {
+		unsigned long long t = now - n->booted;
+
+		n->allocating = false;
+		if (!n->booted)
+			n->cold = t;
+		else {
+			n->warm++;
+			n->warm_sum += t;
+			if (t > n->warm_max)
+				n->warm_max = t;
+		}
+	}
+
+	if (n->ops->receive(buf))
+		n->received++;
+
+	if (n->sending && n->ops->send_state() < 2) {
+		/* TRANSMIT_IDLE or TRANSMIT_FAILED */
+		unsigned long long latency = now - n->queued;
+
+		n->sending = false;
+		if (n->ops->send_state())
+			n->failed++;
+		else {
+			n->sent++;
+			n->latency_sum += latency;
+			if (latency > n->latency_max)
+				n->latency_max = latency;
+		}
+
+		n->ops->send_errs(errs);
+		for (i = 1; i < 7; i++)
+			n->errs[i] += errs[i];
+	}
+
+	if (!n->sending && now >= n->next_send) {
+		node_send(n);
+		n->next_send = now + msg_ns / 2 + rand_range(msg_ns);
+	}
+}
+
+static void run(void)
+{
+	struct sim_node *n;
+	unsigned long long next;
+	unsigned char i;
+
+	while (now < run_ns) {
+		/* Find the next event, the bus first on a tie */
+		next = bus_change;
+		for (i = 0; i < node_count; i++) {
+			n = &nodes[i];
+			if (n->next_hw && n->next_hw < next)
+				next = n->next_hw;
+			if (n->next_periodic < next)
+				next = n->next_periodic;
+		}
+		now = next;
+
+		if (bus_change == now) {
+			bus_edge();
+			continue;
+		}
+
+		for (i = 0; i < node_count; i++) {
+			n = &nodes[i];
+			if (n->next_hw == now) {
+				n->ops->hw_tick();
+				n->next_hw += node_interval(n, n->ops->hw_period_ns);
+				node_update(n);
+				break;
+			}
+			if (n->next_periodic == now) {
+				n->ops->periodic(node_time(n));
+				node_app(n);
+				n->next_periodic += node_interval(n, period_ns -
+					jitter_ns + rand_range(2 * jitter_ns + 1));
+				node_update(n);
+				break;
+			}
+		}
+	}
+
+	if (!bus_high)
+		low_total += now - low_start;
+	busy_total += (busy_end < now ? busy_end : now) - busy_start;
+}
+
+static void report(void)
+{
+	struct sim_node *n;
+	unsigned long sent = 0, failed = 0, received = 0;
+	unsigned long errs[7] = {0};
+	unsigned long long latency_sum = 0, latency_max = 0;
+	unsigned char i, j;
+
+	printf("node driver  skew   sent failed   recv arb_lost nack "
+		"no_eom low_drive hw  lat_ms avg   max\n");
+	for (i = 0; i < node_count; i++) {
+		n = &nodes[i];
+		printf("%4u %-6s %5ld %6lu %6lu %6lu %8lu %4lu %6lu %9lu %2lu"
+			"      %5.1f %5.1f\n", i, n->ops->driver, n->skew_ppm,
+			n->sent, n->failed, n->received,
+			n->errs[CEC_ERR_ARB_LOST], n->errs[CEC_ERR_NACK],
+			n->errs[CEC_ERR_NO_EOM], n->errs[CEC_ERR_LOW_DRIVE],
+			n->errs[CEC_ERR_HW],
+			n->sent ? (double) n->latency_sum / n->sent / MS : 0,
+			(double) n->latency_max / MS);
+
+		sent += n->sent;
+		failed += n->failed;
+		received += n->received;
+		for (j = 1; j < 7; j++)
+			errs[j] += n->errs[j];
+		latency_sum += n->latency_sum;
+		if (n->latency_max > latency_max)
+			latency_max = n->latency_max;
+	}
+	printf("all                %6lu %6lu %6lu %8lu %4lu %6lu %9lu %2lu"
+		"      %5.1f %5.1f\n", sent, failed, received,
+		errs[CEC_ERR_ARB_LOST], errs[CEC_ERR_NACK],
+		errs[CEC_ERR_NO_EOM], errs[CEC_ERR_LOW_DRIVE], errs[CEC_ERR_HW],
+		sent ? (double) latency_sum / sent / MS : 0,
+		(double) latency_max / MS);
+	printf("bus busy %.1f%%, low %.1f%%\n", 100.0 * busy_total / now,
+						100.0 * low_total / now);
+
+	if (alloc) {
+		unsigned long warm = 0;
+		unsigned long long warm_sum = 0, warm_max = 0;
+
+		printf("node addr cold_ms reboots warm_ms avg   max\n");
+		for (i = 0; i < node_count; i++) {
+			n = &nodes[i];
+			printf("%4u %4u %7.1f %7lu         %5.1f %5.1f\n", i,
+				n->ops->addr(), (double) n->cold / MS, n->warm,
+				n->warm ? (double) n->warm_sum / n->warm / MS : 0,
+				(double) n->warm_max / MS);
+			warm += n->warm;
+			warm_sum += n->warm_sum;
+			if (n->warm_max > warm_max)
+				warm_max = n->warm_max;
+		}
+		printf("all                  %7lu         %5.1f %5.1f\n", warm,
+			warm ? (double) warm_sum / warm / MS : 0,
+			(double) warm_max / MS);
+	}
+
+	/* Long waits point at a busy bus or a wedged transmit engine */
+	for (i = 0; i < node_count; i++) {
+		n = &nodes[i];
+		if (n->sending && now - n->queued > 1000 * MS)
+			printf("node %u still sending, queued %.1fs ago\n",
+					i, (double) (now - n->queued) / 1000 / MS);
+	}
+}
+
+/* Driver for each node, 0 usi, 1 raw, 2 icp, 3 usi and raw, 4 all three */
+static int parse_driver(const char *s)
+{
+	if (!strcmp(s, "usi"))
+		return 0;
+	if (!strcmp(s, "raw"))
+		return 1;
+	if (!strcmp(s, "icp"))
+		return 2;
+	if (!strcmp(s, "mix"))
+		return 3;
+	if (!strcmp(s, "all"))
+		return 4;
+	fprintf(stderr, "unknown driver %s\n", s);
+	exit(1);
+}
+
+static int node_driver(int driver, unsigned char i)
+{
+	if (driver == 3)
+		return i & 1;
+	if (driver == 4)
+		return i % 3;
+	return driver;
+}
+
+int main(int argc, char **argv)
+{
+	struct sim_node *n;
+	unsigned long long seed = 1;
+	int driver = 3;
+	unsigned char i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:d:t:s:k:p:j:r:f:m:acb:")) != -1) {
+		switch (c) {
+		case 'n':
+			node_count = atoi(optarg);
+			if (node_count < 1 || node_count > SIM_SLOTS) {
+				fprintf(stderr, "1 to %d nodes\n", SIM_SLOTS);
+				return 1;
+			}
+			break;
+		case 'd': driver = parse_driver(optarg); break;
+		case 't': run_ns = strtod(optarg, NULL) * 1000 * MS; break;
+		case 's': seed = strtoull(optarg, NULL, 0); break;
+		case 'k': skew_ppm = atol(optarg); break;
+		case 'p': period_ns = strtoull(optarg, NULL, 0) * US; break;
+		case 'j': jitter_ns = strtoull(optarg, NULL, 0) * US; break;
+		case 'r': rise_ns = strtoull(optarg, NULL, 0) * US; break;
+		case 'f': fall_ns = strtoull(optarg, NULL, 0) * US; break;
+		case 'm': msg_ns = strtoull(optarg, NULL, 0) * MS; break;
+		case 'a': alloc = true; break;
+		case 'c': alloc = alloc_cache = true; break;
+		case 'b': reboot_ns = strtoull(optarg, NULL, 0) * MS; break;
+		default:
+			return 1;
+		}
+	}
+	if (alloc && node_count > SIM_ALLOC_SLOTS) {
+		fprintf(stderr, "1 to %d nodes with -a\n", SIM_ALLOC_SLOTS);
+		return 1;
+	}
+	if (alloc && (driver == 2 || driver == 4)) {
+		fprintf(stderr, "no icp nodes with -a\n");
+		return 1;
+	}
+	if (jitter_ns > period_ns - 1) {
+		fprintf(stderr, "jitter must be less than the period\n");
+		return 1;
+	}
+
+	/* xorshift state must not be zero */
+	rand_state = seed * 0x9e3779b97f4a7c15ULL + 1;
+
+	for (i = 0; i < node_count; i++) {
+		n = &nodes[i];
+		if (alloc)
+			n->ops = alloc_ops[i][alloc_cache]
+						[node_driver(driver, i)];
+		else
+			n->ops = slot_ops[i][node_driver(driver, i)];
+		n->skew_ppm = (long) rand_range(2 * skew_ppm + 1) - skew_ppm;
+		n->ops->init(i);
+		n->ops->line(true);
+		n->pulls_low = n->ops->pulls_low();
+		if (n->ops->hw_period_ns)
+			n->next_hw = node_interval(n, n->ops->hw_period_ns);
+		n->next_periodic = rand_range(period_ns) + 1;
+		n->next_send = rand_range(msg_ns);
+		n->allocating = alloc;
+		n->next_reboot = alloc ? reboot_ns / 2 + rand_range(reboot_ns) :
+									~0ULL;
+	}
+	bus_update();
+
+	printf("seed %llu, %u nodes, %.1fs\n", seed, node_count,
+						(double) run_ns / 1000 / MS);
+	run();
+	report();
+
+	return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Trace of the USI driver and protocol engine state. First for a random
+ * stream of line samples, then for random messages of our own looped
+ * back onto the line. After each frame of 8 samples, any change to the
+ * state is printed along with the events posted, the messages received
+ * and what went out. The Makefile builds it with and without the
+ * driver's optional fast paths and checks that the traces match.
+ *
+ * Usage: cec_usi_trace [seed]
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CEC_DDR		DDRB
+#define CEC_PIN		PINB
+#define CEC_PORT	PORTB
+#define CEC_PBIN	PB0
+#define CEC_PBOUT	PB1
+
+#define CEC_FIXED_LOGICAL_ADDRESS	CEC_ADDR_PLAYBACK_DEVICE_1
+#define CEC_EVENTS			8
+
+#include "../cec.c"
+
+#define TRACE_SAMPLES	(1UL << 20)
+#define TRACE_LOOPBACK	(1UL << 17)
+
+static void cec_usi_frame_hook(void)
+{
+}
+
+/* One sample per byte, 1 while the line is low */
+static unsigned char samples[TRACE_SAMPLES];
+static unsigned long nsamples;
+
+static void emit(bool low, int n)
+{
+	while (n-- > 0 && nsamples < TRACE_SAMPLES)
+		samples[nsamples++] = low;
+}
+
+/* n, moved by up to j samples either way */
+static int jitter(int n, int j)
+{
+	return n + rand() % (2 * j + 1) - j;
+}
+
+/* Frames of start and data bits, some of them bent, with noise between */
+static void generate(void)
+{
+	int bits;
+	int low;
+	int r;
+
+	while (nsamples < TRACE_SAMPLES - 4000) {
+		r = rand() % 100;
+		emit(false, rand() % 30);
+		if (r < 5) {
+			emit(true, rand() % 20);
+			continue;
+		}
+
+		/* 3.6ms low, 0.9ms high */
+		emit(true, jitter(12, r < 10 ? 2 : 0));
+		emit(false, jitter(3, r < 15));
+
+		for (bits = (1 + rand() % 5) * 10; bits; bits--) {
+			low = rand() & 1 ? 2 : 5;
+			if (rand() % 50 == 0)
+				low = rand() % 8;
+			emit(true, jitter(low, rand() % 20 == 0));
+			emit(false, jitter(8 - low, rand() % 20 == 0));
+		}
+	}
+}
+
+/* Print whatever changed during frame n */
+static void trace(unsigned long n)
+{
+	static unsigned char last[10];
+	unsigned char now[10] = {
+		usi_recv_state, recv_frame, recv_frame_tick, min_frame_ticks,
+		max_frame_ticks, recv_last_bit, cec_receive_flags,
+		cec_receive_pos, cec_receive_byte, idle_frames,
+	};
+	unsigned char type;
+	unsigned char arg;
+	unsigned char len;
+	unsigned char k;
+
+	if (memcmp(now, last, sizeof(now))) {
+		printf("%lu", n);
+		for (k = 0; k < sizeof(now); k++)
+			printf(" %02x", now[k]);
+		printf("\n");
+		memcpy(last, now, sizeof(now));
+	}
+
+	while ((type = cec_event_get(&arg)))
+		printf("%lu event %d %02x\n", n, type, arg);
+
+	while ((len = cec_receive_buf[0])) {
+		printf("%lu rx %02x", n, len);
+		len &= 0x3f;
+		for (k = 0; k < len && k < CEC_BUFFER_SIZE; k++)
+			printf(" %02x", cec_receive_buf[k + 1]);
+		printf("\n");
+		cec_receive_release();
+	}
+}
+
+/* Our own messages, the line reads back each frame one frame late */
+static void loopback(void)
+{
+	unsigned char out = CEC_PAT_IDLE;
+	unsigned char prev = CEC_PAT_IDLE;
+	unsigned char state;
+	unsigned long n;
+	unsigned char i;
+
+	for (n = 0; n < TRACE_LOOPBACK; n++) {
+		if (transmit_state < TRANSMIT_PEND && rand() % 50 == 0) {
+			transmit_buf_end = rand() % 5;
+			for (i = 0; i <= transmit_buf_end; i++)
+				transmit_buf[i] = rand();
+			/* To us so it gets acked, or broadcast */
+			transmit_buf[0] = (transmit_buf[0] & 0xf0) |
+				(rand() % 3 ? CEC_FIXED_LOGICAL_ADDRESS :
+							CEC_ADDR_BROADCAST);
+			transmit_state = TRANSMIT_PEND;
+		}
+
+		USIBR = prev;
+		prev = out;
+		cec_usi_overflow();
+		out = USIBR;
+		trace(n);
+
+		/* Only the engine steps through the EOM and ack states */
+		state = transmit_state;
+		if (state > TRANSMIT_AGAIN && state != TRANSMIT_WAIT_FOR_ACK)
+			state = TRANSMIT_BIT_EOM;
+		printf("%lu tx %02x %d %d %d %d\n", n, out, float_ticks_max_next,
+			state, needed_idle_frames, transmit_last_bit & 3);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long i;
+	unsigned char buf;
+	unsigned char k;
+
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+	generate();
+
+	cec_init();
+	for (i = 0; i + 8 <= nsamples; i += 8) {
+		buf = 0;
+		for (k = 0; k < 8; k++)
+			buf = (buf << 1) | samples[i + k];
+		USIBR = buf;
+		cec_usi_overflow();
+		trace(i / 8);
+	}
+
+	cec_halt();
+	cec_init();
+	loopback();
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Interface between the bus simulator and the nodes on it. Each node is
+ * a separate build of sim_node.c with its own copy of the library and
+ * the register file, and exports one of these.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdbool.h>
+
+/* Node slots, one per logical address below broadcast */
+#define SIM_SLOTS	15
+
+struct sim_node_ops {
+	const char *driver;
+
+	/* Local time between hardware clocks, 0 if there is none */
+	unsigned long hw_period_ns;
+
+	void (*init)(unsigned char addr);
+
+	/* cec_halt and cec_init again, the EEPROM keeps its contents */
+	void (*reboot)(void);
+
+	/* Logical address, 0xff while it is still being allocated */
+	unsigned char (*addr)(void);
+
+	/* The visible level of the bus changed */
+	void (*line)(bool high);
+
+	/* Hardware clock, for the USI this shifts the data register */
+	void (*hw_tick)(void);
+
+	/* App main loop, cec_periodic and friends, local time in ns */
+	void (*periodic)(unsigned long long now);
+
+	/* Node is pulling the bus low */
+	bool (*pulls_low)(void);
+
+	/* Queue a message, false if one is still going out */
+	bool (*send)(const unsigned char *buf, unsigned char len);
+
+	/* transmit_state, and the error counts of the last message */
+	unsigned char (*send_state)(void);
+	void (*send_errs)(unsigned char errs[7]);
+
+	/* Next received message header and data, 0 if there is none */
+	unsigned char (*receive)(unsigned char *buf);
+};
+
+#define SIM_SLOT_OPS(n) \
+	extern const struct sim_node_ops sim_usi_##n, sim_raw_##n, sim_icp_##n;
+
+SIM_SLOT_OPS(0) SIM_SLOT_OPS(1) SIM_SLOT_OPS(2) SIM_SLOT_OPS(3)
+SIM_SLOT_OPS(4) SIM_SLOT_OPS(5) SIM_SLOT_OPS(6) SIM_SLOT_OPS(7)
+SIM_SLOT_OPS(8) SIM_SLOT_OPS(9) SIM_SLOT_OPS(10) SIM_SLOT_OPS(11)
+SIM_SLOT_OPS(12) SIM_SLOT_OPS(13) SIM_SLOT_OPS(14)
+
+/* Playback devices that allocate their address, with and without cache */
+#define SIM_ALLOC_SLOTS	6
+
+#define SIM_ALLOC_OPS(n) \
+	extern const struct sim_node_ops sim_usi_alloc_##n, sim_raw_alloc_##n, \
+		sim_usi_cache_##n, sim_raw_cache_##n;
+
+SIM_ALLOC_OPS(0) SIM_ALLOC_OPS(1) SIM_ALLOC_OPS(2) SIM_ALLOC_OPS(3)
+SIM_ALLOC_OPS(4) SIM_ALLOC_OPS(5)
+
+#endif
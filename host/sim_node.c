@@ -0,0 +1,306 @@
+/*
+ * One node on the simulated bus, built once per slot and driver with
+ * SIM_NODE naming the ops it exports. The library runs unmodified, this
+ * file only plays the part of the pins, the USI or Timer1 and the app.
+ *
+ * Copyright (C) 2016 Russ Dill <russ.dill@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define CEC_DDR		DDRB
+#define CEC_PIN		PINB
+#define CEC_PORT	PORTB
+#define CEC_PBIN	PB0
+#ifdef CEC_ICP
+/* ICP1 and OC1B */
+#define CEC_PBOUT	PB2
+#else
+#define CEC_PBOUT	PB1
+#endif
+
+/* Allocation nodes are built with CEC_DEV_TYPE, the rest use their slot */
+#ifndef CEC_DEV_TYPE
+#define CEC_LOGICAL_ADDRESS_BITFIELD
+#endif
+#define CEC_ERR_STATS
+
+#include "../cec.c"
+
+#ifdef CEC_ICP
+/* Only Timer1 keeps time, cec_periodic gets no deltas */
+#define JIFFY_NS	(TCNT1_PRESCALER * 1000000000ULL / F_CPU)
+#else
+#define JIFFY_NS	(TCNT0_PRESCALER * 1000000000ULL / F_CPU)
+#endif
+
+static unsigned long long node_jiffies;
+
+#ifdef CEC_USI
+/*
+ * USIOIF is write one to clear, which a plain variable can't do. The
+ * driver always sets the counter back to 8 once it has dealt with an
+ * overflow, so that is taken as the clear.
+ */
+static bool usi_overflow;
+
+static void usi_sync(void)
+{
+	if (usi_overflow && (USISR & 8))
+		usi_overflow = false;
+	USISR = (USISR & 0x0f) | (usi_overflow ? _BV(USIOIF) : 0);
+}
+
+static void cec_usi_frame_hook(void)
+{
+}
+
+static void node_hw_tick(void)
+{
+	unsigned char count;
+	unsigned char next;
+
+	if (!TCCR0B)
+		/* Timer0 is stopped */
+		return;
+
+	/* DI shifts in as the next bit goes out on DO */
+	USIDR = (USIDR << 1) | !!(PINB & _BV(CEC_PBIN));
+
+	count = (USISR + 1) & 0x0f;
+	USISR = (USISR & ~0x0f) | count;
+	if (count)
+		return;
+
+	/* Sampled frame goes to the buffer, the written pattern goes out */
+	next = USIBR;
+	USIBR = USIDR;
+	USIDR = next;
+	usi_overflow = true;
+	usi_sync();
+
+#ifdef CEC_USI_ISR
+	if (USICR & _BV(USIOIE)) {
+		CEC_USI_OVF_vect();
+		usi_sync();
+	}
+#endif
+}
+
+static bool node_pulls_low(void)
+{
+	/* Three wire mode, DO follows the top bit of the data register */
+	return !(DDRB & _BV(CEC_PBOUT)) || (USIDR & 0x80);
+}
+#elif defined(CEC_ICP)
+#define usi_sync() icp_sync()
+
+/* OC1B, high pulls the bus low while COM1B has the pin */
+static bool icp_oc1b;
+
+static void icp_compare_output(unsigned char com)
+{
+	switch (com & (_BV(COM1B1) | _BV(COM1B0))) {
+	case _BV(COM1B0):
+		icp_oc1b = !icp_oc1b;
+		break;
+	case _BV(COM1B1):
+		icp_oc1b = false;
+		break;
+	case _BV(COM1B1) | _BV(COM1B0):
+		icp_oc1b = true;
+		break;
+	}
+}
+
+/* Apply a FOC1B write latched while the library ran */
+static void icp_sync(void)
+{
+	if (host_foc1b) {
+		icp_compare_output(host_foc1b);
+		host_foc1b = 0;
+	}
+}
+
+/*
+ * One Timer1 clock, normal mode. The flags in TIFR1 are write one to
+ * clear, so they aren't kept, an enabled vector is called on the match.
+ */
+static void node_hw_tick(void)
+{
+	if (!(TCCR1B & (_BV(CS12) | _BV(CS11) | _BV(CS10))))
+		/* Timer1 is stopped */
+		return;
+
+	TCNT1++;
+	if (TCNT1 == OCR1A && (TIMSK1 & _BV(OCIE1A))) {
+		TIMER1_COMPA_vect();
+		icp_sync();
+	}
+	if (TCNT1 == OCR1B) {
+		icp_compare_output(TCCR1A);
+		if (TIMSK1 & _BV(OCIE1B)) {
+			TIMER1_COMPB_vect();
+			icp_sync();
+		}
+	}
+}
+
+static bool node_pulls_low(void)
+{
+	if (TCCR1A & (_BV(COM1B1) | _BV(COM1B0)))
+		return !(DDRB & _BV(CEC_PBOUT)) || icp_oc1b;
+	return !(DDRB & _BV(CEC_PBOUT)) || (PORTB & _BV(CEC_PBOUT));
+}
+#else
+#define usi_sync() do {} while (0)
+
+static void node_hw_tick(void)
+{
+}
+
+static bool node_pulls_low(void)
+{
+	return !(DDRB & _BV(CEC_PBOUT)) || (PORTB & _BV(CEC_PBOUT));
+}
+#endif
+
+static void node_line(bool high)
+{
+	/* The input is inverted */
+	if (high)
+		PINB &= ~_BV(CEC_PBIN);
+	else
+		PINB |= _BV(CEC_PBIN);
+
+#ifdef CEC_USI_ISR
+	if (CEC_USI_PCMSK & _BV(CEC_PBIN)) {
+		usi_sync();
+		CEC_USI_PCINT_vect();
+		usi_sync();
+	}
+#endif
+#ifdef CEC_RECEIVE_PCINT
+	if (CEC_RECEIVE_PCMSK & _BV(CEC_PBIN))
+		CEC_RECEIVE_PCINT_vect();
+#endif
+#ifdef CEC_ICP
+	/* ICES1 picks the rising pin edge, which is the bus going low */
+	if ((TIMSK1 & _BV(ICIE1)) && !high == !!(TCCR1B & _BV(ICES1))) {
+		ICR1 = TCNT1;
+		TIMER1_CAPT_vect();
+		icp_sync();
+	}
+#endif
+}
+
+static void node_init(unsigned char addr)
+{
+	cec_init();
+#ifdef CEC_LOGICAL_ADDRESS_BITFIELD
+	logical_addresses = 1 << addr;
+#endif
+	usi_sync();
+}
+
+static void node_reboot(void)
+{
+	cec_halt();
+	cec_init();
+	usi_sync();
+}
+
+static unsigned char node_addr(void)
+{
+#ifdef CEC_LOGICAL_ADDRESS_BITFIELD
+	return __builtin_ctz(logical_addresses);
+#else
+	return logical_address;
+#endif
+}
+
+static void node_periodic(unsigned long long now)
+{
+	unsigned long long jiffies = now / JIFFY_NS;
+	unsigned long long delta = jiffies - node_jiffies;
+
+	node_jiffies = jiffies;
+#ifndef CEC_ICP
+	TCNT0 = jiffies;
+#endif
+
+	usi_sync();
+	cec_periodic(delta > 0xffff ? 0xffff : delta);
+	usi_sync();
+}
+
+static bool node_send(const unsigned char *buf, unsigned char len)
+{
+	if (transmit_state >= TRANSMIT_PEND)
+		return false;
+
+	memcpy(transmit_buf, buf, len);
+	transmit_buf_end = len - 1;
+	transmit_state = TRANSMIT_PEND;
+	return true;
+}
+
+static unsigned char node_send_state(void)
+{
+	return transmit_state;
+}
+
+static void node_send_errs(unsigned char errs[7])
+{
+	memcpy(errs, transmit_state_buf, sizeof(transmit_state_buf));
+}
+
+static unsigned char node_receive(unsigned char *buf)
+{
+	unsigned char hdr = cec_receive_buf[0];
+
+	if (hdr) {
+		memcpy(buf, &cec_receive_buf[1], CEC_BUFFER_SIZE);
+		cec_receive_release();
+	}
+	return hdr;
+}
+
+const struct sim_node_ops SIM_NODE = {
+#ifdef CEC_USI
+	.driver = "usi",
+	.hw_period_ns = SAMPLE_US * 1000,
+#elif defined(CEC_ICP)
+	.driver = "icp",
+	.hw_period_ns = JIFFY_NS,
+#else
+	.driver = "raw",
+#endif
+	.init = node_init,
+	.reboot = node_reboot,
+	.addr = node_addr,
+	.line = node_line,
+	.hw_tick = node_hw_tick,
+	.periodic = node_periodic,
+	.pulls_low = node_pulls_low,
+	.send = node_send,
+	.send_state = node_send_state,
+	.send_errs = node_send_errs,
+	.receive = node_receive,
+};
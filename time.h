@@ -217,7 +217,7 @@
 #endif
 
 #ifndef __ASSEMBLER__
-__uint24 jiffies(void);
+TIME_PUBLIC __uint24 jiffies(void);
 #endif
 
 #endif